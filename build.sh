@@ -422,8 +422,8 @@ compile_binaries() {
 
                 "$prebuilt_path/${target}-linux-android21-clang++" \
                     $CXXFLAGS -Wall -Wextra -static-libstdc++ \
-                    -I src -I src/ \
-                    -o "$output" "$cpp_file" || exit 1
+                    -I src \
+                    -o "$output" "$cpp_file" -lz || exit 1
 
                 "$prebuilt_path/llvm-strip" "$output" || log_warn "Failed to strip $output"
             ) &
@@ -441,6 +441,32 @@ compile_binaries() {
     wait || handle_error "Compilation failed"
 }
 
+# 构建 native 程序使用的日志库：静态库和 C 头文件输出到源码目录的 sdk/，不随模块打包
+compile_library() {
+    local prebuilt_path="$ANDROID_NDK_HOME/toolchains/llvm/prebuilt/$([ $IS_WINDOWS -eq 1 ] && echo 'windows' || echo 'linux')-x86_64/bin"
+    local targets=(aarch64 x86_64)
+    local sdk_dir="$ORIGINAL_DIR/sdk"
+
+    mkdir -p "$sdk_dir/include"
+    cp src/ammf_log.h "$sdk_dir/include/" || handle_error "Failed to copy ammf_log.h"
+
+    for target in "${targets[@]}"; do
+        log_info "Building libammf_log for $target..."
+        mkdir -p "$sdk_dir/$target"
+        local object="$sdk_dir/$target/ammf_log.o"
+
+        # 不使用 -flto，库的使用方不必启用 LTO
+        "$prebuilt_path/${target}-linux-android21-clang++" \
+            -O3 -std=c++20 -fPIC -Wall -Wextra \
+            -I src \
+            -c src/lib/ammf_log.cpp -o "$object" || handle_error "Failed to compile libammf_log for $target"
+        rm -f "$sdk_dir/$target/libammf_log.a"
+        "$prebuilt_path/llvm-ar" rcs "$sdk_dir/$target/libammf_log.a" "$object" || handle_error "Failed to archive libammf_log for $target"
+        rm -f "$object"
+    done
+    log_info "libammf_log written to $sdk_dir (link with -lammf_log -lz -pthread)"
+}
+
 # Main function
 main() {
     trap cleanup EXIT
@@ -471,9 +497,10 @@ main() {
 
     # 替换标识符
     find files webroot -type f -name "*.sh" -o -name "*.js" -exec sed -i "s/AMMF/${action_id}/g" {} +
-    find src -name "*.cpp" -exec sed -i "s/AMMF2/${action_id}/g" {} +
+    find src \( -name "*.cpp" -o -name "*.hpp" -o -name "*.h" \) -exec sed -i "s/AMMF2/${action_id}/g" {} +
     sed -i "s/AMMF/${action_id}/g" webroot/index.html
     compile_binaries
+    compile_library
     rm -rf src
     package_module "$version"
     log_info "Build completed successfully!"
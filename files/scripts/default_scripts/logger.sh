@@ -11,7 +11,8 @@ LOG_FILE_NAME="system"
 LOGMONITOR_PID=""
 LOGMONITOR_BIN="${MODPATH}/bin/logmonitor"
 LOG_LEVEL=3  # 1=ERROR, 2=WARN, 3=INFO, 4=DEBUG
-LOW_POWER_MODE=0  # 默认关闭低功耗模式
+LOW_POWER_MODE=0  # 默认关闭低功耗模式，auto 为未充电且熄屏时自动进入
+LOG_RATE_LIMIT="50/500"  # 每个日志每个级别的限流（条/秒/突发），空为不限制
 
 # ============================
 # 核心功能
@@ -31,10 +32,13 @@ init_logger() {
         
         if [ -z "$LOGMONITOR_PID" ]; then
             # 添加低功耗模式参数
+            # 重复消息合并为摘要，刷屏的日志按 LOG_RATE_LIMIT 限流
             if [ "$LOW_POWER_MODE" = "1" ]; then
-                "$LOGMONITOR_BIN" -c daemon -d "$LOG_DIR" -l "$LOG_LEVEL" -p >/dev/null 2>&1 &
+                "$LOGMONITOR_BIN" -c daemon -d "$LOG_DIR" -l "$LOG_LEVEL" -D -R "${LOG_RATE_LIMIT:-0}" -p >/dev/null 2>&1 &
+            elif [ "$LOW_POWER_MODE" = "auto" ]; then
+                "$LOGMONITOR_BIN" -c daemon -d "$LOG_DIR" -l "$LOG_LEVEL" -D -R "${LOG_RATE_LIMIT:-0}" -P >/dev/null 2>&1 &
             else
-                "$LOGMONITOR_BIN" -c daemon -d "$LOG_DIR" -l "$LOG_LEVEL" >/dev/null 2>&1 &
+                "$LOGMONITOR_BIN" -c daemon -d "$LOG_DIR" -l "$LOG_LEVEL" -D -R "${LOG_RATE_LIMIT:-0}" >/dev/null 2>&1 &
             fi
             LOGMONITOR_PID=$!
             sleep 0.1  # 减少等待时间
@@ -104,12 +108,17 @@ set_log_level() {
 set_low_power_mode() {
     if [ "$1" = "1" ] || [ "$1" = "true" ] || [ "$1" = "on" ]; then
         LOW_POWER_MODE=1
+    elif [ "$1" = "auto" ]; then
+        LOW_POWER_MODE=auto
     else
         LOW_POWER_MODE=0
     fi
     
     # 如果日志系统已初始化，则需要重启
-    if [ "$LOGGER_INITIALIZED" = "1" ]; then
+    # 守护进程常驻托管监控项时不能重启，新模式在守护进程下次启动时生效
+    if [ "$LOGGER_INITIALIZED" = "1" ] && [ "$LOGMONITOR_RESIDENT" = "1" ]; then
+        log_warn "Low power mode change takes effect after the resident logmonitor restarts"
+    elif [ "$LOGGER_INITIALIZED" = "1" ]; then
         stop_logger
         init_logger
     fi
@@ -128,7 +137,12 @@ clean_logs() {
 }
 
 # 停止日志系统
+# 守护进程托管了监控项或服务进程（LOGMONITOR_RESIDENT=1）时只刷新缓冲区，保持其常驻
 stop_logger() {
+    if [ "$LOGGER_INITIALIZED" = "1" ] && [ "$LOGMONITOR_RESIDENT" = "1" ]; then
+        "$LOGMONITOR_BIN" -c flush
+        return 0
+    fi
     if [ "$LOGGER_INITIALIZED" = "1" ] && [ -n "$LOGMONITOR_PID" ]; then
         # 先刷新缓冲区
         "$LOGMONITOR_BIN" -c flush
@@ -17,43 +17,13 @@ log_info "开始执行service_script.sh"
 
 sleep 60
 
-# 创建临时日志文件
-GPU_LOG_FILE="$MODDIR/logs/gpu_scheduler_output.log"
-
-# 启动gpu-scheduler并将输出重定向到临时文件
-nohup $MODDIR/gpu-scheduler > "$GPU_LOG_FILE" 2>&1 &
-
-# 等待一小段时间以确保有输出
-sleep 2
-
-# 检查日志文件是否存在且有内容
-if [ -f "$GPU_LOG_FILE" ] && [ -s "$GPU_LOG_FILE" ]; then
-    # 获取前20行日志
-    GPU_LOG_CONTENT=$(head -n 20 "$GPU_LOG_FILE")
-
-    # 记录到日志系统
-    if [ -f "$MODDIR/bin/logmonitor" ]; then
-        # 设置日志文件名为gpu-scheduler
-        "$MODDIR/bin/logmonitor" -c write -n "gpu-scheduler" -m "GPU调度器已启动" -l 3 >/dev/null 2>&1
-
-        # 逐行记录前20行日志
-        echo "$GPU_LOG_CONTENT" | while read -r line; do
-            if [ -n "$line" ]; then
-                "$MODDIR/bin/logmonitor" -c write -n "gpu-scheduler" -m "$line" -l 4 >/dev/null 2>&1
-            fi
-        done
-
-        # 记录日志完成信息
-        "$MODDIR/bin/logmonitor" -c write -n "gpu-scheduler" -m "以上为GPU调度器启动的前20行日志" -l 3 >/dev/null 2>&1
-    fi
-
-    # 输出日志完成信息
-    Aurora_ui_print "GPU调度器日志已记录到 $MODDIR/logs/gpu-scheduler.log"
+# 由logmonitor守护进程启动gpu-scheduler，stdout/stderr 持续写入 gpu-scheduler 日志
+if [ -f "$MODDIR/bin/logmonitor" ] && "$MODDIR/bin/logmonitor" -c spawn -n "gpu-scheduler" -m "$MODDIR/gpu-scheduler" >/dev/null 2>&1; then
+    LOGMONITOR_RESIDENT=1
+    "$MODDIR/bin/logmonitor" -c write -n "gpu-scheduler" -m "GPU调度器已启动" -l 3 >/dev/null 2>&1
+    Aurora_ui_print "GPU调度器日志将记录到 $MODDIR/logs/gpu-scheduler.log"
 else
-    # 记录错误信息
-    if [ -f "$MODDIR/bin/logmonitor" ]; then
-        "$MODDIR/bin/logmonitor" -c write -n "gpu-scheduler" -m "GPU调度器启动但未产生输出" -l 2 >/dev/null 2>&1
-    fi
-
-    Aurora_ui_print "GPU调度器启动但未产生输出"
+    # 守护进程不可用时直接后台运行，不再记录输出
+    nohup "$MODDIR/gpu-scheduler" >/dev/null 2>&1 &
+    Aurora_ui_print "GPU调度器已启动（日志守护进程不可用，输出未记录）"
 fi
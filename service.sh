@@ -36,29 +36,92 @@ abort() {
 }
 
 # 进入暂停模式的函数
+# 用法: enter_pause_mode [-k] 文件 脚本 [文件 -c 命令 ...] 或 enter_pause_mode -f 监控清单
+# 默认文件被写入、touch 或 chmod 都会触发；-k 只在内容真正变化时触发，
+# 变化的配置项通过环境变量传给脚本。监控清单中的选项由清单自行指定
+# logmonitor守护进程在运行时由它托管监控项，动作输出写入 filewatch 日志；
+# 否则所有监控项由同一个filewatch进程处理
 enter_pause_mode() {
+    local filewatch_keys=""
+    local watch_options=""
+    if [ "$1" = "-k" ]; then
+        filewatch_keys="-K"
+        watch_options="keys"
+        shift
+    fi
     log_info "${SERVICE_PAUSED:-已进入暂停模式，监控文件}: $1"
 
-    # 检查参数数量
-    if [ "$#" -eq 2 ]; then
-        # 如果是两个参数，第二个参数是脚本路径
-        log_debug "Use Script: $2"
-        if [ -f "$MODPATH/bin/filewatch" ]; then
-            "$MODPATH/bin/filewatch" "$1" "$2"
-        else
+    local hosted=0
+    [ -f "$MODPATH/bin/logmonitor" ] && hosted=1
+
+    if [ "$#" -eq 2 ] && [ "$1" = "-f" ]; then
+        log_debug "Use watch list: $2"
+        if [ "$hosted" = "1" ] && "$MODPATH/bin/logmonitor" -c watch -b "$2" >/dev/null 2>&1; then
+            LOGMONITOR_RESIDENT=1
+            return 0
+        fi
+        if [ ! -f "$MODPATH/bin/filewatch" ]; then
             log_error "filewatch$SERVICE_FILE_NOT_FOUND"
+            return 1
         fi
-    elif [ "$#" -eq 3 ] && [ "$2" = "-c" ]; then
-        # 如果是三个参数且第二个是-c，第三个参数是shell命令
-        log_debug "使用shell命令: $3"
-        if [ -f "$MODPATH/bin/filewatch" ]; then
-            "$MODPATH/bin/filewatch" -c "$3" "$1"
+        "$MODPATH/bin/filewatch" -f "$2"
+        return
+    fi
+
+    # 将 "文件 脚本" / "文件 -c 命令" 参数组转换为 -w 选项，同时尝试交给守护进程托管
+    local remaining=$#
+    local watch_path
+    local watch_action
+    local registered=""
+    while [ "$remaining" -gt 0 ]; do
+        watch_path=$1
+        shift
+        remaining=$((remaining - 1))
+        if [ "$remaining" -ge 2 ] && [ "$1" = "-c" ]; then
+            # 文件后跟 -c，下一个参数是shell命令
+            log_debug "使用shell命令: $2"
+            watch_action="-c $2"
+            set -- "$@" -w "$watch_path" -c "$2"
+            shift 2
+            remaining=$((remaining - 2))
+        elif [ "$remaining" -ge 1 ] && [ "$1" != "-c" ]; then
+            # 文件后跟脚本路径
+            log_debug "Use Script: $1"
+            watch_action=$1
+            set -- "$@" -w "$watch_path" -a "$1"
+            shift
+            remaining=$((remaining - 1))
         else
-            log_error "filewatch$SERVICE_FILE_NOT_FOUND"
+            log_error "enter_pause_mode的参数无效"
+            return 1
         fi
-    else
-        log_error "enter_pause_mode的参数无效"
+        if [ "$hosted" = "1" ]; then
+            if "$MODPATH/bin/logmonitor" -c watch -w "$watch_path" -m "$watch_action" ${watch_options:+-O "$watch_options"} >/dev/null 2>&1; then
+                registered="$registered
+$watch_path"
+            else
+                hosted=0
+            fi
+        fi
+    done
+
+    # 部分监控项注册失败时注销已注册的项，避免与filewatch重复触发
+    if [ "$hosted" = "0" ] && [ -n "$registered" ]; then
+        echo "$registered" | while IFS= read -r watch_path; do
+            [ -n "$watch_path" ] && "$MODPATH/bin/logmonitor" -c unwatch -w "$watch_path" >/dev/null 2>&1
+        done
+    fi
+
+    if [ "$hosted" = "1" ]; then
+        LOGMONITOR_RESIDENT=1
+        return 0
+    fi
+
+    if [ ! -f "$MODPATH/bin/filewatch" ]; then
+        log_error "filewatch$SERVICE_FILE_NOT_FOUND"
+        return 1
     fi
+    "$MODPATH/bin/filewatch" $filewatch_keys "$@"
 }
 
 # 记录启动信息
@@ -0,0 +1,68 @@
+#ifndef AMMF_LOG_H
+#define AMMF_LOG_H
+
+// native 程序的日志接口：在进程内写入日志目录，或把记录发送给 logmonitor 守护进程，无需 fork/exec。
+// 静态库 libammf_log.a 由 build.sh 构建，链接时需要 -lz -pthread（C 程序另加 -lc++ 或 -lstdc++）
+//
+//   ammf_log* log = ammf_log_open("gpu-scheduler", NULL, AMMF_LOG_INFO);
+//   AMMF_LOGF(log, AMMF_LOG_INFO, "frequency %d MHz", freq);
+//   ammf_log_close(log);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 日志级别，与 logmonitor -l 相同
+enum {
+    AMMF_LOG_ERROR = 1,
+    AMMF_LOG_WARN = 2,
+    AMMF_LOG_INFO = 3,
+    AMMF_LOG_DEBUG = 4
+};
+
+typedef struct ammf_log ammf_log;
+
+// 句柄的公开部分，供 ammf_log_enabled 内联判断级别
+struct ammf_log_head {
+    int level;
+};
+
+// 打开日志 name，只记录 level 及更严重的级别。
+// target 为目录时在进程内写入该目录（同一目录的句柄共用一个写入线程）；
+// 为 NULL 或 '@' 开头的套接字名时发送给守护进程（NULL 为默认套接字）。失败时返回 NULL
+ammf_log* ammf_log_open(const char* name, const char* target, int level);
+
+// 该级别是否会被记录
+static inline int ammf_log_enabled(const ammf_log* log, int level) {
+    return log != 0 && level <= ((const struct ammf_log_head*)(const void*)log)->level;
+}
+
+// 写入一条记录，成功返回 0，失败返回 -1。可在多个线程中同时调用
+int ammf_log_write(ammf_log* log, int level, const char* message);
+
+// 按 printf 格式写入一条记录
+int ammf_log_printf(ammf_log* log, int level, const char* format, ...)
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 3, 4)))
+#endif
+    ;
+
+// 写出已缓冲的记录：进程内写入时落盘，连接守护进程时立即发送并请守护进程刷新
+int ammf_log_flush(ammf_log* log);
+
+// 刷新并关闭句柄
+void ammf_log_close(ammf_log* log);
+
+// 级别被过滤时不求值参数、不格式化
+#define AMMF_LOGF(log, level, ...)                                \
+    do {                                                          \
+        if (ammf_log_enabled((log), (level))) {                   \
+            ammf_log_printf((log), (level), __VA_ARGS__);         \
+        }                                                         \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AMMF_LOG_H
@@ -0,0 +1,94 @@
+// 时间戳格式化微基准：对比原有的互斥锁 + 按秒缓存实现与 log_time.hpp
+// 构建（不随模块打包）:
+//   clang++ -O3 -std=c++20 -I src -o log_time_bench src/bench/log_time_bench.cpp -pthread
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "log_time.hpp"
+
+// 原实现：每次调用加锁并读取时钟，跨秒时重新 localtime_r + strftime
+class LegacyFormatter {
+public:
+    LegacyFormatter() {
+        last_time_format = std::chrono::system_clock::now();
+        update_time_cache();
+    }
+
+    const char* get_formatted_time() {
+        std::lock_guard<std::mutex> lock(time_mutex);
+
+        auto now = std::chrono::system_clock::now();
+        if (now - last_time_format < std::chrono::seconds(1)) {
+            return time_buffer;
+        }
+
+        last_time_format = now;
+        update_time_cache();
+        return time_buffer;
+    }
+
+private:
+    char time_buffer[32];
+    std::chrono::system_clock::time_point last_time_format;
+    std::mutex time_mutex;
+
+    void update_time_cache() {
+        auto now_time = std::chrono::system_clock::to_time_t(last_time_format);
+        std::tm now_tm;
+        localtime_r(&now_time, &now_tm);
+        std::strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", &now_tm);
+    }
+};
+
+static volatile char sink;
+
+// 多线程并发运行 fn，返回每次调用的平均纳秒数
+template <typename Fn>
+static double run(int threads, int iterations, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            for (int i = 0; i < iterations; ++i) {
+                sink = fn()[18];
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return elapsed / (static_cast<double>(iterations) * threads);
+}
+
+int main() {
+    constexpr int iterations = 2000000;
+    LegacyFormatter legacy;
+
+    for (int threads : {1, 4}) {
+        // 仅读取时钟的开销作为基线
+        double clock_ns = run(threads, iterations, [] {
+            static thread_local char buffer[32];
+            buffer[18] = static_cast<char>(std::chrono::system_clock::now().time_since_epoch().count());
+            return buffer;
+        });
+        double legacy_ns = run(threads, iterations, [&] { return legacy.get_formatted_time(); });
+        double seconds_ns = run(threads, iterations, [] {
+            return format_time(std::chrono::system_clock::now(), TIME_SECONDS);
+        });
+        double millis_ns = run(threads, iterations, [] {
+            return format_time(std::chrono::system_clock::now(), TIME_MILLIS);
+        });
+        double micros_ns = run(threads, iterations, [] {
+            return format_time(std::chrono::system_clock::now(), TIME_MICROS);
+        });
+
+        std::printf("threads=%d clock=%.1fns legacy=%.1fns seconds=%.1fns millis=%.1fns micros=%.1fns\n",
+                    threads, clock_ns, legacy_ns, seconds_ns, millis_ns, micros_ns);
+    }
+    std::printf("sample: %s\n", format_time(std::chrono::system_clock::now(), TIME_MICROS));
+    return 0;
+}
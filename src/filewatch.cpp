@@ -1,207 +1,353 @@
 #include <string>
-#include <unistd.h>
-#include <cerrno>
-#include <csignal>
-#include <sys/inotify.h>
-#include <fcntl.h>
-#include <poll.h>
+#include <vector>
+#include <cstdio>
 #include <sys/resource.h>
+#include <sys/signalfd.h>
 
-#define EVENT_SIZE (sizeof(struct inotify_event))
-#define BUF_LEN (512 * (EVENT_SIZE + 16))  // 减小缓冲区大小以节省内存
+#include "watch_engine.hpp"
 
-static int fd, wd;
-static volatile sig_atomic_t running = 1;  // 使用 sig_atomic_t 确保原子操作
-static std::string target_file;
-static std::string script_path;
-static std::string shell_command;
 static int daemon_mode = 0;
-static int verbose = 0;
-static int check_interval = 30;  // 默认监听间隔改为30秒
-static int low_power_mode = 1;   // 默认开启低功耗模式
-
-// 智能休眠时间控制
-static struct {
-    unsigned int base_interval;   // 基础休眠时间
-    unsigned int max_interval;    // 最大休眠时间
-    unsigned int current;         // 当前休眠时间
-} sleep_control = {500000, 5000000, 500000};
-
-void handle_signal(int sig) {
-    (void)sig;
-    running = 0;
-}
+static int check_interval = 30;  // 无法挂载的监控项的重试间隔（秒）
+static int quiet_ms = 500;        // 最后一次变化后等待的安静时间
+static int max_latency_ms = 3000; // 变化持续不断时的最长等待时间
+static int max_running = 1;       // 同时运行的动作数量上限
+static ActionPolicy default_policy = POLICY_QUEUE;
+static int default_timeout = 0;   // 动作超时（秒），0 表示不限制
+static bool default_hash = false; // -H/-K 出现在任何 -w 之前时作用于所有监控项
+static bool default_keys = false;
 
 void optimize_process_priority() {
     // 设置进程优先级为低优先级，减少CPU使用
+    // 监控表随目录数量动态增长，不再用 RLIMIT_AS 限制地址空间
     setpriority(PRIO_PROCESS, 0, 19);
-    
-    // 设置进程资源限制
-    struct rlimit rlim;
-    rlim.rlim_cur = rlim.rlim_max = BUF_LEN;
-    setrlimit(RLIMIT_AS, &rlim);  // 限制内存使用
 }
 
 void daemonize() {
     pid_t pid = fork();
     if (pid < 0) exit(EXIT_FAILURE);
     if (pid > 0) exit(EXIT_SUCCESS);
-    
+
     if (setsid() < 0) exit(EXIT_FAILURE);
     signal(SIGHUP, SIG_IGN);
-    
+
     pid = fork();
     if (pid < 0) exit(EXIT_FAILURE);
     if (pid > 0) exit(EXIT_SUCCESS);
-    
+
     chdir("/");
     close(STDIN_FILENO);
     close(STDOUT_FILENO);
     close(STDERR_FILENO);
-    
+
     open("/dev/null", O_RDWR);
     dup(0);
     dup(0);
 }
 
-void execute_script() {
-    if (!shell_command.empty()) {
-        system(shell_command.c_str());
-    } else {
-        system(script_path.c_str());
-    }
-}
-
 void print_usage(const char *prog_name) {
-    write(STDOUT_FILENO, "Usage: ", 7);
-    write(STDOUT_FILENO, prog_name, strlen(prog_name));
-    write(STDOUT_FILENO, " [options] <file_to_monitor> <script_to_execute>\n", 47);
-    write(STDOUT_FILENO, "Options:\n", 9);
-    write(STDOUT_FILENO, "  -d            Run in daemon mode\n", 34);
-    write(STDOUT_FILENO, "  -v            Enable verbose logging\n", 38);
-    write(STDOUT_FILENO, "  -i <seconds>  Set check interval (default 30 seconds)\n", 53);
-    write(STDOUT_FILENO, "  -c <command>  Execute shell command instead of script file\n", 59);
-    write(STDOUT_FILENO, "  -l            Enable low power mode (default: enabled)\n", 54);
-    write(STDOUT_FILENO, "  -h            Display this help information\n", 44);
+    write_str(STDOUT_FILENO, std::string("Usage: ") + prog_name + " [options] <file_to_monitor> <script_to_execute>\n");
+    write_str(STDOUT_FILENO, std::string("       ") + prog_name + " [options] -w <path> -a <script> [-w <path> -c <command> -r ...]\n");
+    write_str(STDOUT_FILENO, "Options:\n");
+    write_str(STDOUT_FILENO, "  -d            Run in daemon mode\n");
+    write_str(STDOUT_FILENO, "  -v            Enable verbose logging, dump action latency on exit or SIGUSR1\n");
+    write_str(STDOUT_FILENO, "  -i <seconds>  Retry interval for paths that cannot be watched yet (default 30)\n");
+    write_str(STDOUT_FILENO, "  -c <command>  Execute shell command instead of script file\n");
+    write_str(STDOUT_FILENO, "  -l            Accepted for compatibility, waiting is always event-driven\n");
+    write_str(STDOUT_FILENO, "  -q <ms>       Quiet window before firing (default 500)\n");
+    write_str(STDOUT_FILENO, "  -m <ms>       Longest delay while changes keep coming (default 3000)\n");
+    write_str(STDOUT_FILENO, "  -j <count>    Maximum actions running at once (default 1)\n");
+    write_str(STDOUT_FILENO, "  -P <policy>   When an action is still running: queue or cancel (default queue)\n");
+    write_str(STDOUT_FILENO, "  -t <seconds>  Kill an action after this long (default 0, no limit)\n");
+    write_str(STDOUT_FILENO, "  -H            Only fire when file content changes (CRC32C)\n");
+    write_str(STDOUT_FILENO, "  -K            Like -H, and pass changed KEY=value keys to the action\n");
+    write_str(STDOUT_FILENO, "  -w <path>     Add a watched file or directory (repeatable)\n");
+    write_str(STDOUT_FILENO, "  -a <script>   Script to execute for the last -w path\n");
+    write_str(STDOUT_FILENO, "  -r            Watch the last -w directory recursively\n");
+    write_str(STDOUT_FILENO, "  -I <glob>     Only react to matching entries of the last -w directory\n");
+    write_str(STDOUT_FILENO, "  -E <glob>     Ignore matching entries of the last -w directory\n");
+    write_str(STDOUT_FILENO, "  -f <file>     Read watches from a list, one 'path|action|options' per line\n");
+    write_str(STDOUT_FILENO, "  -h            Display this help information\n");
 }
 
-void adjust_sleep_interval(bool file_changed) {
-    if (file_changed) {
-        // 如果文件发生变化，重置为基础间隔
-        sleep_control.current = sleep_control.base_interval;
-    } else {
-        // 如果文件没有变化，逐渐增加休眠时间
-        sleep_control.current = std::min(sleep_control.current * 2, sleep_control.max_interval);
+
+static bool load_watch_list(const char* list_path, std::vector<WatchSpec>& specs) {
+    FILE* file = fopen(list_path, "re");
+    if (!file) {
+        write_str(STDERR_FILENO, std::string("Error: Cannot open watch list ") + list_path + "\n");
+        return false;
+    }
+    char* line = nullptr;
+    size_t capacity = 0;
+    ssize_t length;
+    int line_number = 0;
+    bool ok = true;
+    while ((length = getline(&line, &capacity, file)) != -1) {
+        ++line_number;
+        std::string text = trim(std::string(line, length > 0 && line[length - 1] == '\n' ? length - 1 : length));
+        if (text.empty() || text[0] == '#') continue;
+        WatchSpec spec;
+        if (!parse_watch_line(text, spec)) {
+            write_str(STDERR_FILENO, std::string("Error: Invalid watch list entry at line ") +
+                                     std::to_string(line_number) + "\n");
+            ok = false;
+            break;
+        }
+        specs.push_back(std::move(spec));
     }
+    free(line);
+    fclose(file);
+    return ok;
 }
 
 int main(int argc, char *argv[]) {
+    std::vector<WatchSpec> specs;
+    std::string legacy_command;  // 未跟随 -w 的 -c，作用于位置参数给出的文件
     int opt;
-    while ((opt = getopt(argc, argv, "dvi:c:lh")) != -1) {
+    while ((opt = getopt(argc, argv, "dvi:c:lq:m:j:P:t:HKhw:a:rI:E:f:")) != -1) {
         switch (opt) {
             case 'd': daemon_mode = 1; break;
-            case 'v': verbose = 1; break;
-            case 'i': 
+            case 'v': watch_verbose = true; break;
+            case 'i':
                 check_interval = atoi(optarg);
                 if (check_interval < 1) check_interval = 30;
                 break;
-            case 'c': shell_command = optarg; break;
-            case 'l': low_power_mode = 1; break;
+            case 'c':
+                if (specs.empty()) {
+                    legacy_command = optarg;
+                } else {
+                    specs.back().action.command = optarg;
+                    specs.back().action.shell = true;
+                }
+                break;
+            case 'l': break;  // 旧的低功耗模式，现在空闲时本就无限期阻塞
+            case 'q':
+                quiet_ms = atoi(optarg);
+                if (quiet_ms < 0) quiet_ms = 500;
+                break;
+            case 'm':
+                max_latency_ms = atoi(optarg);
+                if (max_latency_ms < 0) max_latency_ms = 3000;
+                break;
+            case 'j':
+                max_running = atoi(optarg);
+                if (max_running < 1) max_running = 1;
+                break;
+            case 'P':
+            case 't': {
+                // 跟在 -w 之后只作用于该监控项，否则作为全局默认值
+                Action* target = specs.empty() ? nullptr : &specs.back().action;
+                if (opt == 't') {
+                    (target ? target->timeout : default_timeout) = std::max(atoi(optarg), 0);
+                } else if (!parse_policy(optarg, target ? target->policy : default_policy)) {
+                    write_str(STDERR_FILENO, "Error: Invalid policy, use queue or cancel\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 'H':
+            case 'K':
+                if (specs.empty()) {
+                    default_hash = true;
+                    default_keys = default_keys || opt == 'K';
+                } else {
+                    specs.back().hash = true;
+                    specs.back().keys = specs.back().keys || opt == 'K';
+                }
+                break;
+            case 'w':
+                specs.emplace_back();
+                specs.back().path = normalize_path(optarg);
+                break;
+            case 'a':
+            case 'r':
+            case 'I':
+            case 'E':
+                if (specs.empty()) {
+                    write_str(STDERR_FILENO, std::string("Error: -") + static_cast<char>(opt) + " must follow -w <path>\n");
+                    return EXIT_FAILURE;
+                }
+                if (opt == 'a') specs.back().action.command = optarg, specs.back().action.shell = false;
+                else if (opt == 'r') specs.back().recursive = true;
+                else if (opt == 'I') specs.back().includes.push_back(optarg);
+                else specs.back().excludes.push_back(optarg);
+                break;
+            case 'f':
+                if (!load_watch_list(optarg, specs)) return EXIT_FAILURE;
+                break;
             case 'h': print_usage(argv[0]); return EXIT_SUCCESS;
             default: print_usage(argv[0]); return EXIT_FAILURE;
         }
     }
-    
-    if (optind >= argc) {
-        write(STDERR_FILENO, "Error: Missing file path to monitor\n", 35);
-        print_usage(argv[0]);
-        return EXIT_FAILURE;
+
+    // 兼容旧用法: filewatch [-c command] <file> [script]
+    if (optind < argc) {
+        WatchSpec spec;
+        spec.path = normalize_path(argv[optind]);
+        if (!legacy_command.empty()) {
+            spec.action.command = legacy_command;
+            spec.action.shell = true;
+        } else if (optind + 1 < argc) {
+            spec.action.command = argv[optind + 1];
+        } else {
+            write_str(STDERR_FILENO, "Error: No shell command (-c) or script path provided\n");
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        specs.push_back(std::move(spec));
     }
-    
-    target_file = argv[optind];
-    
-    if (shell_command.empty() && optind + 1 >= argc) {
-        write(STDERR_FILENO, "Error: No shell command (-c) or script path provided\n", 51);
+
+    if (specs.empty()) {
+        write_str(STDERR_FILENO, "Error: Missing file path to monitor\n");
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
-    
-    if (shell_command.empty()) {
-        script_path = argv[optind + 1];
-    }
-    
-    if (access(target_file.c_str(), F_OK) == -1) {
-        write(STDERR_FILENO, "Error: Cannot access monitored file\n", 35);
-        return EXIT_FAILURE;
+    for (auto& spec : specs) {
+        if (spec.action.policy == POLICY_DEFAULT) spec.action.policy = default_policy;
+        if (spec.action.timeout < 0) spec.action.timeout = default_timeout;
+        spec.hash = spec.hash || default_hash;
+        spec.keys = spec.keys || default_keys;
+        if (spec.action.command.empty()) {
+            write_str(STDERR_FILENO, "Error: No shell command (-c) or script path provided for " + spec.path + "\n");
+            return EXIT_FAILURE;
+        }
     }
-    
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
-    
+
     if (daemon_mode) {
         daemonize();
     }
-    
+
     optimize_process_priority();  // 优化进程优先级
-    
-    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
-    if (fd < 0) return EXIT_FAILURE;
-    
-    wd = inotify_add_watch(fd, target_file.c_str(), IN_MODIFY | IN_ATTRIB);
-    if (wd < 0) {
-        close(fd);
+
+    // 信号统一经 signalfd 进入事件循环
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &signals, nullptr) < 0) return EXIT_FAILURE;
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) return EXIT_FAILURE;
+
+    WatchEngine engine(std::move(specs));
+    if (!engine.open()) return EXIT_FAILURE;
+
+    Debouncer debouncer{std::chrono::milliseconds(quiet_ms), std::chrono::milliseconds(max_latency_ms)};
+    if (!debouncer.open()) return EXIT_FAILURE;
+    Executor executor(static_cast<size_t>(max_running));
+    if (!executor.open()) return EXIT_FAILURE;
+
+    ContentTracker tracker;
+    std::vector<Trigger> triggers;
+    engine.arm_pending(triggers, true);
+    for (const auto& spec : engine.watch_specs()) {
+        if (spec.hash && !spec.is_dir) {
+            tracker.prime(spec.path, spec.keys);
+        }
+    }
+    if (engine.armed_count() == 0) {
+        write_str(STDERR_FILENO, "Error: Cannot access monitored file\n");
         return EXIT_FAILURE;
     }
-    
-    struct pollfd fds[1];
-    fds[0].fd = fd;
-    fds[0].events = POLLIN;
-    
-    char buffer[BUF_LEN] __attribute__((aligned(8)));  // 内存对齐优化
-    bool file_changed = false;
-    
+    for (const auto& spec : engine.watch_specs()) {
+        if (spec.root_wd < 0) {
+            write_str(STDERR_FILENO, "Warning: Cannot watch " + spec.path + " yet, will retry\n");
+        }
+    }
+
+    // 事件源：inotify、防抖定时器、信号、动作超时定时器
+    enum : uint32_t {
+        SOURCE_INOTIFY = 1u << 0,
+        SOURCE_DEBOUNCE = 1u << 1,
+        SOURCE_SIGNAL = 1u << 2,
+        SOURCE_DEADLINE = 1u << 3
+    };
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) return EXIT_FAILURE;
+    const std::pair<int, uint32_t> sources[] = {
+        {engine.fd(), SOURCE_INOTIFY},
+        {debouncer.fd(), SOURCE_DEBOUNCE},
+        {signal_fd, SOURCE_SIGNAL},
+        {executor.deadline_fd(), SOURCE_DEADLINE},
+    };
+    for (const auto& source : sources) {
+        struct epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.u32 = source.second;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, source.first, &event) < 0) return EXIT_FAILURE;
+    }
+
+    std::vector<Batch> due;
+    struct epoll_event events[4];
+    bool running = true;
     while (running) {
-        int poll_ret = poll(fds, 1, check_interval * 1000);
-        
-        if (poll_ret < 0) {
+        // 只有存在待重新挂载的监控项时才需要超时，否则无限期阻塞
+        int timeout = engine.has_pending() ? check_interval * 1000 : -1;
+        int count = epoll_wait(epoll_fd, events, 4, timeout);
+        if (count < 0) {
             if (errno == EINTR) continue;
             break;
         }
-        
-        if (poll_ret == 0) {
-            if (low_power_mode) {
-                adjust_sleep_interval(false);
-                usleep(sleep_control.current);
+
+        uint32_t ready = 0;
+        for (int i = 0; i < count; ++i) {
+            ready |= events[i].data.u32;
+        }
+
+        triggers.clear();
+        if (count == 0) {
+            engine.arm_pending(triggers, false);
+        }
+        if (ready & SOURCE_INOTIFY) {
+            if (!engine.read_events(triggers)) break;
+            // 原子替换会使所在目录的监控失效，立即尝试重新挂载
+            if (engine.has_pending()) {
+                engine.arm_pending(triggers, false);
             }
-            continue;
         }
-        
-        if (fds[0].revents & POLLIN) {
-            int length = read(fd, buffer, BUF_LEN);
-            if (length < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
-                break;
+        if (!triggers.empty()) {
+            debouncer.add(triggers, Debouncer::Clock::now());
+        }
+
+        if (ready & SOURCE_DEBOUNCE) {
+            due.clear();
+            debouncer.collect_due(due, Debouncer::Clock::now());
+            for (auto& batch : due) {
+                const WatchSpec& spec = engine.watch_specs()[batch.spec];
+                if (spec.hash && !tracker.filter(spec, batch)) {
+                    log_verbose("content unchanged under " + spec.path + ", skipped");
+                    continue;
+                }
+                log_verbose("changed " + std::to_string(batch.paths.size()) + " path(s) under " + spec.path);
+                executor.submit(batch.spec, spec.action, std::move(batch));
             }
-            
-            int i = 0;
-            file_changed = false;
-            while (i < length) {
-                struct inotify_event *event = (struct inotify_event*)&buffer[i];
-                if (event->mask & (IN_MODIFY | IN_ATTRIB)) {
-                    file_changed = true;
-                    execute_script();
-                    if (low_power_mode) {
-                        adjust_sleep_interval(true);
-                        sleep(3);  // 执行后休眠3秒，避免频繁执行
-                    }
+        }
+
+        if (ready & SOURCE_SIGNAL) {
+            bool child_exited = false;
+            struct signalfd_siginfo info;
+            while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                if (info.ssi_signo == SIGCHLD) {
+                    child_exited = true;
+                } else if (info.ssi_signo == SIGUSR1) {
+                    executor.latency().dump(STDERR_FILENO);
+                } else {
+                    running = false;
                 }
-                i += EVENT_SIZE + event->len;
             }
+            if (child_exited) {
+                executor.reap();
+            }
+        }
+        if (ready & SOURCE_DEADLINE) {
+            executor.expire();
         }
     }
-    
-    inotify_rm_watch(fd, wd);
-    close(fd);
-    
+
+    if (watch_verbose) {
+        executor.latency().dump(STDERR_FILENO);
+    }
+    close(epoll_fd);
+    close(signal_fd);
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
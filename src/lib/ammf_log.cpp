@@ -0,0 +1,270 @@
+// ammf_log.h 的实现：进程内写入使用 Logger，发送给守护进程使用 LogClient。
+// 由 build.sh 构建为静态库 libammf_log.a，不随模块打包
+#include "ammf_log.h"
+#include "log_engine.hpp"
+
+#include <cstdarg>
+#include <cstdio>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// 连接守护进程时攒批发送的最长间隔，ERROR 记录立即发送；
+// 到期未发出的记录由共用的发送线程发出，调用方之后不再写入也不会滞留
+constexpr auto SEND_INTERVAL = std::chrono::milliseconds(100);
+
+// 同一目录的进程内句柄共用一个 Logger 和它的刷新线程
+std::mutex loggers_mutex;
+std::map<std::string, std::weak_ptr<Logger>, std::less<>> loggers;
+
+std::shared_ptr<Logger> shared_logger(std::string_view dir) {
+    std::lock_guard<std::mutex> lock(loggers_mutex);
+    auto it = loggers.find(dir);
+    if (it == loggers.end()) {
+        it = loggers.emplace(std::string(dir), std::weak_ptr<Logger>()).first;
+    }
+    auto logger = it->second.lock();
+    if (!logger) {
+        logger = std::make_shared<Logger>(dir, LOG_DEBUG);  // 级别由各句柄过滤
+        it->second = logger;
+    }
+    return logger;
+}
+
+} // namespace
+
+struct ammf_log_state {
+    std::string name;
+    std::shared_ptr<Logger> logger;
+    Logger::LogId log_id{Logger::INVALID_LOG};  // 进程内写入时打开句柄即驻留，写入不再查找名称
+
+    // 连接守护进程时使用，client 非线程安全
+    std::mutex client_mutex;
+    std::unique_ptr<LogClient> client;
+    Clock::time_point last_send{Clock::now()};
+    bool unsent{false};  // 有攒下未发送的记录
+
+    // 发送攒下的记录（调用方需持有 client_mutex），守护进程不可用时丢弃这批记录
+    bool send_pending() {
+        last_send = Clock::now();
+        unsent = false;
+        if (client->send()) {
+            return true;
+        }
+        client->take_pending([](LogLevel, std::string_view, std::string_view, std::string_view) {});
+        return false;
+    }
+
+    bool write(LogLevel level, std::string_view message) {
+        if (logger) {
+            logger->write_log(log_id, level, message);
+            return true;
+        }
+
+        bool ok = true;
+        bool schedule;
+        {
+            std::lock_guard<std::mutex> lock(client_mutex);
+            if (!client->append(static_cast<char>('0' + level), name, message)) {
+                ok = send_pending();
+                client->append(static_cast<char>('0' + level), name, message);
+            }
+            if (level == LOG_ERROR || Clock::now() - last_send >= SEND_INTERVAL) {
+                ok = send_pending() && ok;
+                schedule = false;
+            } else {
+                // 第一条攒下的记录交给发送线程计时
+                schedule = !unsent;
+                unsent = true;
+            }
+        }
+        if (schedule) {
+            send_later();
+        }
+        return ok;
+    }
+
+    void send_later();
+};
+
+namespace {
+
+// 连接守护进程的句柄共用的发送线程：有句柄攒下记录时等待一个发送间隔，再发出所有句柄攒下的记录。
+// 锁顺序为 mutex -> client_mutex，句柄持有 client_mutex 时不能调用 wake
+class SendFlusher {
+public:
+    static SendFlusher& instance() {
+        static SendFlusher flusher;
+        return flusher;
+    }
+
+    ~SendFlusher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    void add(ammf_log_state* state) {
+        std::lock_guard<std::mutex> lock(mutex);
+        states.push_back(state);
+        if (!thread.joinable()) {
+            thread = std::thread([this] { run(); });
+        }
+    }
+
+    // 句柄关闭前移除，返回后发送线程不再访问它
+    void remove(ammf_log_state* state) {
+        std::lock_guard<std::mutex> lock(mutex);
+        states.erase(std::remove(states.begin(), states.end(), state), states.end());
+    }
+
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = true;
+        }
+        cv.notify_one();
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            cv.wait(lock, [this] { return stopping || pending; });
+            pending = false;
+            cv.wait_for(lock, SEND_INTERVAL, [this] { return stopping; });
+            for (ammf_log_state* state : states) {
+                std::lock_guard<std::mutex> client_lock(state->client_mutex);
+                if (state->unsent) {
+                    state->send_pending();
+                }
+            }
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<ammf_log_state*> states;
+    bool pending{false};
+    bool stopping{false};
+    std::thread thread;
+};
+
+} // namespace
+
+void ammf_log_state::send_later() {
+    SendFlusher::instance().wake();
+}
+
+// head 必须是第一个成员，ammf_log_enabled 直接读取其中的级别
+struct ammf_log {
+    ammf_log_head head;
+    ammf_log_state* state;
+};
+
+extern "C" {
+
+ammf_log* ammf_log_open(const char* name, const char* target, int level) {
+    if (!name || !*name) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    try {
+        auto state = std::make_unique<ammf_log_state>();
+        state->name = name;
+        if (target && target[0] != '@') {
+            state->logger = shared_logger(target);
+            state->log_id = state->logger->log_id(state->name);
+        } else {
+            state->client = std::make_unique<LogClient>(target ? target : DEFAULT_SOCKET_NAME);
+            if (!state->client->is_open()) {
+                errno = EINVAL;
+                return nullptr;
+            }
+            SendFlusher::instance().add(state.get());
+        }
+        return new ammf_log{{std::clamp(level, static_cast<int>(AMMF_LOG_ERROR), static_cast<int>(AMMF_LOG_DEBUG))},
+                            state.release()};
+    } catch (const std::exception&) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+}
+
+int ammf_log_write(ammf_log* log, int level, const char* message) {
+    if (!log || level < AMMF_LOG_ERROR) {
+        return -1;
+    }
+    if (!ammf_log_enabled(log, level)) {
+        return 0;
+    }
+    return log->state->write(static_cast<LogLevel>(level), message ? message : "") ? 0 : -1;
+}
+
+int ammf_log_printf(ammf_log* log, int level, const char* format, ...) {
+    if (!log || level < AMMF_LOG_ERROR || !format) {
+        return -1;
+    }
+    if (!ammf_log_enabled(log, level)) {
+        return 0;
+    }
+
+    // 先格式化到栈上，放不下时按实际长度重新格式化
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    va_list retry;
+    va_copy(retry, args);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    bool ok;
+    if (length < 0) {
+        ok = false;
+    } else if (static_cast<size_t>(length) < sizeof(text)) {
+        ok = log->state->write(static_cast<LogLevel>(level), std::string_view(text, static_cast<size_t>(length)));
+    } else {
+        std::string long_text(static_cast<size_t>(length) + 1, '\0');
+        vsnprintf(long_text.data(), long_text.size(), format, retry);
+        long_text.pop_back();
+        ok = log->state->write(static_cast<LogLevel>(level), long_text);
+    }
+    va_end(retry);
+    return ok ? 0 : -1;
+}
+
+int ammf_log_flush(ammf_log* log) {
+    if (!log) {
+        return -1;
+    }
+    ammf_log_state& state = *log->state;
+    if (state.logger) {
+        state.logger->flush_buffer(state.name);
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(state.client_mutex);
+    bool ok = state.send_pending();
+    state.client->append('F', state.name, {});
+    return state.send_pending() && ok ? 0 : -1;
+}
+
+void ammf_log_close(ammf_log* log) {
+    if (!log) {
+        return;
+    }
+    if (log->state->client) {
+        SendFlusher::instance().remove(log->state);
+    }
+    ammf_log_flush(log);
+    delete log->state;
+    delete log;
+}
+
+} // extern "C"
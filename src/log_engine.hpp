@@ -0,0 +1,4098 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <array>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cstddef>
+#include <cerrno>
+#include <climits>
+#include <limits>
+#include <charconv>
+#include <format>
+#include <iterator>
+#include <type_traits>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/file.h>
+#include <zlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#define AMMF_HAVE_IO_URING 1
+#endif
+
+#include "log_time.hpp"
+
+// 日志引擎：记录队列、缓冲写入、轮换压缩、内存映射段、崩溃恢复日志，以及连接守护进程的客户端。
+// logmonitor 守护进程和命令行使用，native 程序经 ammf_log.h 的 C 接口在进程内使用
+
+// 守护进程套接字名称，以 '@' 开头表示抽象命名空间
+static constexpr const char* DEFAULT_SOCKET_NAME = "@AMMF2_logmonitor";
+// 单个数据报最大长度
+static constexpr size_t MAX_DATAGRAM_SIZE = 65536;
+// 崩溃恢复日志的文件名（位于日志目录中）
+static constexpr const char* JOURNAL_FILE = "logmonitor.journal";
+
+// 日志级别定义
+enum LogLevel {
+    LOG_ERROR = 1,
+    LOG_WARN = 2,
+    LOG_INFO = 3,
+    LOG_DEBUG = 4
+};
+
+// 队列满时的处理策略
+enum OverflowPolicy {
+    OVERFLOW_BLOCK,       // 阻塞生产者直到有空位
+    OVERFLOW_DROP_OLDEST, // 丢弃最旧的记录
+    OVERFLOW_DROP_DEBUG   // 队列接近满时优先丢弃 DEBUG 记录，其余阻塞
+};
+
+// 有界多生产者环形队列 - 生产者无锁入队，由刷新线程出队
+// 每个槽位固定大小，超长记录转存到堆上
+class RecordRing {
+public:
+    using SysClock = std::chrono::system_clock;
+
+    static constexpr size_t CAPACITY = 1024;         // 必须为 2 的幂
+    static constexpr size_t SLOT_DATA_SIZE = 212;    // 槽位内联数据大小
+    static constexpr uint32_t NO_JOURNAL = UINT32_MAX;
+
+    // 出队时交给消费者的记录视图
+    struct Record {
+        SysClock::time_point timestamp;
+        LogLevel level;
+        uint32_t log_id;  // Logger 驻留的日志 id
+        uint32_t journal_offset;  // 崩溃恢复日志中的位置，NO_JOURNAL 表示未记录
+        std::string_view tag;
+        std::string_view message;
+        bool deferred;    // message 为延迟格式化的内容
+    };
+
+    RecordRing() : slots(std::make_unique<Slot[]>(CAPACITY)) {
+        for (size_t i = 0; i < CAPACITY; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~RecordRing() {
+        // 释放未消费的超长记录
+        while (pop([](const Record&) {})) {}
+    }
+
+    RecordRing(const RecordRing&) = delete;
+    RecordRing& operator=(const RecordRing&) = delete;
+
+    // 尝试入队，队列已满返回 false
+    bool push(SysClock::time_point timestamp, LogLevel level, uint32_t log_id,
+              std::string_view tag, std::string_view message, bool deferred = false,
+              uint32_t journal_offset = NO_JOURNAL) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots[pos & (CAPACITY - 1)];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->timestamp = timestamp;
+        slot->level = level;
+        slot->deferred = deferred;
+        slot->log_id = log_id;
+        slot->journal_offset = journal_offset;
+        slot->tag_len = static_cast<uint32_t>(tag.size());
+        slot->message_len = static_cast<uint32_t>(message.size());
+        size_t total = tag.size() + message.size();
+        if (total <= SLOT_DATA_SIZE) {
+            std::memcpy(slot->data, tag.data(), tag.size());
+            std::memcpy(slot->data + tag.size(), message.data(), message.size());
+            slot->overflow = nullptr;
+        } else {
+            // 超长记录走堆分配
+            slot->overflow = new std::string();
+            slot->overflow->reserve(total);
+            slot->overflow->append(tag);
+            slot->overflow->append(message);
+        }
+
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 尝试出队一条记录并交给回调处理，队列为空返回 false
+    template <typename Consumer>
+    bool pop(Consumer&& consume) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots[pos & (CAPACITY - 1)];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        const char* data = slot->overflow ? slot->overflow->data() : slot->data;
+        consume(Record{slot->timestamp, slot->level, slot->log_id, slot->journal_offset,
+                       std::string_view(data, slot->tag_len),
+                       std::string_view(data + slot->tag_len, slot->message_len),
+                       slot->deferred});
+
+        delete slot->overflow;
+        slot->overflow = nullptr;
+        slot->sequence.store(pos + CAPACITY, std::memory_order_release);
+        return true;
+    }
+
+    // 当前队列中的记录数（近似值）
+    [[nodiscard]] size_t size() const noexcept {
+        size_t head = enqueue_pos.load(std::memory_order_relaxed);
+        size_t tail = dequeue_pos.load(std::memory_order_relaxed);
+        return head >= tail ? head - tail : 0;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        SysClock::time_point timestamp;
+        LogLevel level{LOG_INFO};
+        bool deferred{false};
+        uint32_t log_id{0};
+        uint32_t journal_offset{NO_JOURNAL};
+        uint32_t tag_len{0};
+        uint32_t message_len{0};
+        std::string* overflow{nullptr};
+        char data[SLOT_DATA_SIZE];
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+};
+
+// 获取日志级别字符串
+[[nodiscard]] constexpr const char* get_level_string(LogLevel level) noexcept {
+    switch (level) {
+        case LOG_ERROR: return "ERROR";
+        case LOG_WARN:  return "WARN";
+        case LOG_INFO:  return "INFO";
+        case LOG_DEBUG: return "DEBUG";
+        default:        return "UNKNOWN";
+    }
+}
+
+// 文本格式单条记录的长度
+[[nodiscard]] inline size_t text_record_size(const char* time_str, LogLevel level,
+                                             std::string_view tag, std::string_view message) noexcept {
+    size_t size = strlen(time_str) + strlen(get_level_string(level)) + message.size() + 5;
+    if (!tag.empty()) {
+        size += tag.size() + 3;
+    }
+    return size;
+}
+
+// 追加文本格式记录: "YYYY-MM-DD HH:MM:SS [LEVEL] [tag] message\n"
+inline void append_text_record(std::string& out, const char* time_str, LogLevel level,
+                               std::string_view tag, std::string_view message) {
+    out += time_str;
+    out += " [";
+    out += get_level_string(level);
+    out += "] ";
+    if (!tag.empty()) {
+        out += '[';
+        out += tag;
+        out += "] ";
+    }
+    out += message;
+    out += '\n';
+}
+
+// 延迟格式化的记录内容：生产者只拷贝格式串和参数，文本由刷新线程（二进制日志为读取时）生成
+//   <u32 格式串长度><格式串><u8 参数个数>，之后每个参数为 <u8 类型><值>
+//   整数统一为 8 字节（std::format 按数值输出，与原类型宽度无关），字符串为 <u32 长度><内容>
+namespace deferred {
+
+enum ArgType : uint8_t {
+    ARG_NONE = 0,
+    ARG_BOOL,
+    ARG_CHAR,
+    ARG_INT,      // 有符号整数，存为 int64_t
+    ARG_UINT,     // 无符号整数，存为 uint64_t
+    ARG_FLOAT,
+    ARG_DOUBLE,
+    ARG_STRING,   // const char*、std::string、std::string_view，拷贝内容
+    ARG_POINTER   // const void*，只记录地址
+};
+
+template <typename T>
+consteval ArgType arg_type() {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::is_same_v<U, bool>) {
+        return ARG_BOOL;
+    } else if constexpr (std::is_same_v<U, char>) {
+        return ARG_CHAR;
+    } else if constexpr (std::is_integral_v<U> && sizeof(U) <= 8) {
+        return std::is_signed_v<U> ? ARG_INT : ARG_UINT;
+    } else if constexpr (std::is_same_v<U, float>) {
+        return ARG_FLOAT;
+    } else if constexpr (std::is_same_v<U, double>) {
+        return ARG_DOUBLE;
+    } else if constexpr (std::is_convertible_v<const U&, std::string_view>) {
+        return ARG_STRING;
+    } else if constexpr (std::is_same_v<U, std::nullptr_t> ||
+                         (std::is_pointer_v<U> && std::is_void_v<std::remove_pointer_t<U>>)) {
+        return ARG_POINTER;
+    } else {
+        return ARG_NONE;
+    }
+}
+
+template <typename T>
+inline void put_raw(std::string& out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+template <typename T>
+inline bool get_raw(std::string_view& in, T& value) {
+    if (in.size() < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&value, in.data(), sizeof(T));
+    in.remove_prefix(sizeof(T));
+    return true;
+}
+
+template <typename T>
+inline void put_arg(std::string& out, const T& value) {
+    constexpr ArgType type = arg_type<T>();
+    out += static_cast<char>(type);
+    if constexpr (type == ARG_BOOL || type == ARG_CHAR) {
+        out += static_cast<char>(value);
+    } else if constexpr (type == ARG_INT) {
+        put_raw<int64_t>(out, value);
+    } else if constexpr (type == ARG_UINT) {
+        put_raw<uint64_t>(out, value);
+    } else if constexpr (type == ARG_FLOAT || type == ARG_DOUBLE) {
+        put_raw(out, value);
+    } else if constexpr (type == ARG_STRING) {
+        std::string_view text(value);
+        put_raw(out, static_cast<uint32_t>(text.size()));
+        out.append(text);
+    } else if constexpr (std::is_same_v<std::remove_cvref_t<T>, std::nullptr_t>) {
+        put_raw<uint64_t>(out, 0);
+    } else {
+        put_raw<uint64_t>(out, reinterpret_cast<uintptr_t>(value));
+    }
+}
+
+// 序列化格式串和参数，追加到 out
+template <typename... Args>
+inline void encode(std::string& out, std::string_view format, const Args&... args) {
+    static_assert(sizeof...(Args) <= UINT8_MAX, "too many log arguments");
+    static_assert(((arg_type<Args>() != ARG_NONE) && ...),
+                  "deferred log arguments must be arithmetic, strings or const void*");
+    put_raw(out, static_cast<uint32_t>(format.size()));
+    out.append(format);
+    out += static_cast<char>(sizeof...(Args));
+    (put_arg(out, args), ...);
+}
+
+namespace detail {
+
+struct Arg {
+    ArgType type{ARG_NONE};
+    union {
+        bool b;
+        char c;
+        int64_t i;
+        uint64_t u;
+        float f;
+        double d;
+        const void* p;
+    };
+    std::string_view s;
+};
+
+inline bool get_arg(std::string_view& in, Arg& arg) {
+    if (in.empty()) {
+        return false;
+    }
+    arg.type = static_cast<ArgType>(in[0]);
+    in.remove_prefix(1);
+    switch (arg.type) {
+        case ARG_BOOL:
+        case ARG_CHAR:
+            if (in.empty()) {
+                return false;
+            }
+            arg.type == ARG_BOOL ? void(arg.b = in[0] != 0) : void(arg.c = in[0]);
+            in.remove_prefix(1);
+            return true;
+        case ARG_INT: return get_raw(in, arg.i);
+        case ARG_UINT: return get_raw(in, arg.u);
+        case ARG_FLOAT: return get_raw(in, arg.f);
+        case ARG_DOUBLE: return get_raw(in, arg.d);
+        case ARG_POINTER: {
+            uint64_t address;
+            if (!get_raw(in, address)) {
+                return false;
+            }
+            arg.p = reinterpret_cast<const void*>(static_cast<uintptr_t>(address));
+            return true;
+        }
+        case ARG_STRING: {
+            uint32_t length;
+            if (!get_raw(in, length) || in.size() < length) {
+                return false;
+            }
+            arg.s = in.substr(0, length);
+            in.remove_prefix(length);
+            return true;
+        }
+        default: return false;
+    }
+}
+
+// 按 "{:spec}" 格式化单个参数
+inline void format_arg(std::string& out, const Arg& arg, std::string_view spec) {
+    std::string field = "{:";
+    field += spec;
+    field += '}';
+    auto put = [&](auto value) {
+        std::vformat_to(std::back_inserter(out), field, std::make_format_args(value));
+    };
+    switch (arg.type) {
+        case ARG_BOOL: put(arg.b); break;
+        case ARG_CHAR: put(arg.c); break;
+        case ARG_INT: put(arg.i); break;
+        case ARG_UINT: put(arg.u); break;
+        case ARG_FLOAT: put(arg.f); break;
+        case ARG_DOUBLE: put(arg.d); break;
+        case ARG_STRING: put(arg.s); break;
+        case ARG_POINTER: put(arg.p); break;
+        default: break;
+    }
+}
+
+// 把 spec 中嵌套的 {} / {n}（动态宽度、精度）替换为对应整数参数的值
+inline bool resolve_spec(std::string& resolved, std::string_view spec, const std::vector<Arg>& args, size_t& next) {
+    resolved.clear();
+    for (size_t i = 0; i < spec.size(); ++i) {
+        if (spec[i] != '{') {
+            resolved += spec[i];
+            continue;
+        }
+        size_t close = spec.find('}', i);
+        if (close == std::string_view::npos) {
+            return false;
+        }
+        std::string_view id = spec.substr(i + 1, close - i - 1);
+        size_t index = next;
+        if (id.empty()) {
+            ++next;
+        } else if (std::from_chars(id.data(), id.data() + id.size(), index).ec != std::errc{}) {
+            return false;
+        }
+        if (index >= args.size() || (args[index].type != ARG_INT && args[index].type != ARG_UINT)) {
+            return false;
+        }
+        resolved += args[index].type == ARG_INT ? std::to_string(args[index].i) : std::to_string(args[index].u);
+        i = close;
+    }
+    return true;
+}
+
+} // namespace detail
+
+// 按 std::format 的规则逐个替换字段，格式串已在编译期检查过
+inline bool render_fields(std::string& out, std::string_view payload) {
+    uint32_t format_size;
+    if (!get_raw(payload, format_size) || payload.empty() || payload.size() - 1 < format_size) {
+        return false;
+    }
+    std::string_view format = payload.substr(0, format_size);
+    payload.remove_prefix(format_size);
+    size_t count = static_cast<uint8_t>(payload[0]);
+    payload.remove_prefix(1);
+
+    thread_local std::vector<detail::Arg> args;
+    args.assign(count, detail::Arg{});
+    for (auto& arg : args) {
+        if (!detail::get_arg(payload, arg)) {
+            return false;
+        }
+    }
+
+    thread_local std::string spec;
+    size_t next = 0;
+    try {
+        size_t i = 0;
+        while (i < format.size()) {
+            size_t brace = format.find_first_of("{}", i);
+            if (brace == std::string_view::npos) {
+                out.append(format.substr(i));
+                break;
+            }
+            out.append(format.substr(i, brace - i));
+            if (brace + 1 < format.size() && format[brace + 1] == format[brace]) {
+                out += format[brace];  // {{ 或 }}
+                i = brace + 2;
+                continue;
+            }
+            if (format[brace] == '}') {
+                return false;
+            }
+
+            // 字段结束位置，跳过 spec 中嵌套的 {}
+            size_t close = brace + 1;
+            int depth = 1;
+            for (; close < format.size(); ++close) {
+                if (format[close] == '{') {
+                    ++depth;
+                } else if (format[close] == '}' && --depth == 0) {
+                    break;
+                }
+            }
+            if (close >= format.size()) {
+                return false;
+            }
+            std::string_view field = format.substr(brace + 1, close - brace - 1);
+            size_t colon = field.find(':');
+            std::string_view id = field.substr(0, colon);
+            size_t index = next;
+            if (id.empty()) {
+                ++next;
+            } else if (std::from_chars(id.data(), id.data() + id.size(), index).ec != std::errc{}) {
+                return false;
+            }
+            if (index >= args.size() ||
+                !detail::resolve_spec(spec, colon == std::string_view::npos ? std::string_view() : field.substr(colon + 1),
+                                      args, next)) {
+                return false;
+            }
+            detail::format_arg(out, args[index], spec);
+            i = close + 1;
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// 生成文本追加到 out，内容损坏时以 "<invalid deferred record>" 结尾并返回 false
+inline bool render(std::string& out, std::string_view payload) {
+    if (render_fields(out, payload)) {
+        return true;
+    }
+    out += "<invalid deferred record>";
+    return false;
+}
+
+} // namespace deferred
+
+// 二进制日志格式
+//   文件头: "AMLB" + 版本号（2 起可含 FORMAT 记录，版本 1 的文件仍可读取）
+//   记录:   <kind> ...
+//     BLOCK:  重置时间基准和标签表，每次刷新的数据块以此开头，保证轮换后仍可独立解析
+//     TAGDEF: varint 标签 id, varint 长度, 标签名
+//     LEVEL:  (0x10 | 级别), zigzag varint 时间差(ms), varint 标签 id(0 表示无), varint 长度, 内容
+//     FORMAT: (0x20 | 级别), 其余同 LEVEL，内容为 deferred 序列化的格式串和参数，读取时才生成文本
+namespace binlog {
+
+constexpr char MAGIC[] = {'A', 'M', 'L', 'B', 2};
+constexpr size_t MAGIC_SIZE = sizeof(MAGIC);
+constexpr uint8_t MIN_VERSION = 1;
+constexpr const char* FILE_SUFFIX = ".blog";
+
+constexpr uint8_t KIND_BLOCK = 0x00;
+constexpr uint8_t KIND_TAGDEF = 0x01;
+constexpr uint8_t KIND_RECORD = 0x10;
+constexpr uint8_t KIND_FORMAT = 0x20;
+
+// 文件头是否为可读取的版本
+inline bool valid_magic(std::string_view header) {
+    return header.size() >= MAGIC_SIZE && std::memcmp(header.data(), MAGIC, MAGIC_SIZE - 1) == 0 &&
+           static_cast<uint8_t>(header[MAGIC_SIZE - 1]) >= MIN_VERSION &&
+           static_cast<uint8_t>(header[MAGIC_SIZE - 1]) <= static_cast<uint8_t>(MAGIC[MAGIC_SIZE - 1]);
+}
+
+inline void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+// 读取 varint，数据不完整时返回 false
+inline bool get_varint(std::string_view& in, uint64_t& value) {
+    value = 0;
+    for (size_t i = 0; i < in.size() && i < 10; ++i) {
+        auto byte = static_cast<uint8_t>(in[i]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80)) {
+            in.remove_prefix(i + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// 编码器状态 - 随每次刷新的数据块重置
+struct Encoder {
+    bool started{false};
+    int64_t last_ms{0};
+    std::vector<std::string> tags;
+
+    void reset() {
+        started = false;
+        last_ms = 0;
+        tags.clear();
+    }
+
+    // 编码一条记录，返回追加的字节数；deferred 表示 message 为延迟格式化的内容
+    size_t encode(std::string& out, int64_t timestamp_ms, LogLevel level,
+                  std::string_view tag, std::string_view message, bool deferred = false) {
+        size_t start = out.size();
+        if (!started) {
+            out += static_cast<char>(KIND_BLOCK);
+            started = true;
+        }
+
+        uint64_t tag_id = 0;
+        if (!tag.empty()) {
+            auto it = std::find(tags.begin(), tags.end(), tag);
+            if (it == tags.end()) {
+                tags.emplace_back(tag);
+                tag_id = tags.size();
+                out += static_cast<char>(KIND_TAGDEF);
+                put_varint(out, tag_id);
+                put_varint(out, tag.size());
+                out += tag;
+            } else {
+                tag_id = static_cast<uint64_t>(it - tags.begin()) + 1;
+            }
+        }
+
+        out += static_cast<char>((deferred ? KIND_FORMAT : KIND_RECORD) | static_cast<uint8_t>(level));
+        put_varint(out, zigzag(timestamp_ms - last_ms));
+        put_varint(out, tag_id);
+        put_varint(out, message.size());
+        out += message;
+        last_ms = timestamp_ms;
+        return out.size() - start;
+    }
+};
+
+// 流式解码器 - 逐块输入数据，渲染为文本格式
+class Decoder {
+public:
+    explicit Decoder(TimePrecision precision = TIME_SECONDS) : precision(precision) {}
+
+    // 解码 data 中的完整记录并追加到 out，返回已消耗的字节数
+    size_t decode(std::string_view data, std::string& out) {
+        size_t total = data.size();
+        while (!data.empty()) {
+            std::string_view rest = data;
+            auto kind = static_cast<uint8_t>(rest[0]);
+            rest.remove_prefix(1);
+
+            if (kind == KIND_BLOCK) {
+                last_ms = 0;
+                tags.clear();
+            } else if (kind == KIND_TAGDEF) {
+                uint64_t id, length;
+                if (!get_varint(rest, id) || !get_varint(rest, length) || rest.size() < length) {
+                    break;
+                }
+                // 编码器按顺序分配编号，只接受下一个编号或已有编号，其余视为损坏并跳过
+                if (id == tags.size() + 1) {
+                    tags.emplace_back(rest.data(), length);
+                } else if (id > 0 && id <= tags.size()) {
+                    tags[id - 1].assign(rest.data(), length);
+                }
+                rest.remove_prefix(length);
+            } else if ((kind & 0xF0) == KIND_RECORD || (kind & 0xF0) == KIND_FORMAT) {
+                uint64_t delta, tag_id, length;
+                if (!get_varint(rest, delta) || !get_varint(rest, tag_id) ||
+                    !get_varint(rest, length) || rest.size() < length) {
+                    break;
+                }
+                last_ms += unzigzag(delta);
+                std::chrono::system_clock::time_point tp{std::chrono::milliseconds(last_ms)};
+                std::string_view tag = (tag_id > 0 && tag_id <= tags.size()) ? std::string_view(tags[tag_id - 1]) : std::string_view();
+                std::string_view message = rest.substr(0, length);
+                if ((kind & 0xF0) == KIND_FORMAT) {
+                    rendered.clear();
+                    deferred::render(rendered, message);
+                    message = rendered;
+                }
+                append_text_record(out, format_time(tp, precision), static_cast<LogLevel>(kind & 0x0F), tag, message);
+                rest.remove_prefix(length);
+            } else {
+                // 无法识别的字节，跳过以尽量恢复
+            }
+            data = rest;
+        }
+        return total - data.size();
+    }
+
+private:
+    TimePrecision precision;
+    int64_t last_ms{0};
+    std::vector<std::string> tags;
+    std::string rendered;
+};
+
+} // namespace binlog
+
+// 文本日志的侧边索引 NAME.log.idx
+//   每 BLOCK_RECORDS 条记录（以及每次刷新的末尾）一个定长条目：块在日志中的偏移和长度、
+//   时间范围、包含的级别。轮换时随日志改名为 NAME.log.N.idx，压缩后的历史代仍按未压缩偏移索引。
+//   索引只用于跳过不可能匹配的块，缺失或过期时查询退回全文扫描
+namespace logindex {
+
+constexpr const char* FILE_SUFFIX = ".idx";
+constexpr uint16_t BLOCK_RECORDS = 64;
+
+struct Entry {
+    uint64_t offset;   // 块在日志文件中的起始偏移（未压缩）
+    uint32_t length;   // 块的字节数
+    uint16_t records;
+    uint8_t levels;    // 第 (级别 - 1) 位表示块内含该级别的记录
+    uint8_t reserved;
+    int64_t min_ms;    // 块内最早/最晚的记录时间（毫秒）
+    int64_t max_ms;
+};
+static_assert(sizeof(Entry) == 32, "index entries are written as-is");
+
+// 缓冲区中的块，偏移相对于缓冲区开头，刷新时再换算为文件偏移
+struct Builder {
+    std::vector<Entry> blocks;
+    Entry current{};
+
+    void add(size_t offset, size_t length, LogLevel level, int64_t timestamp_ms) {
+        if (current.records == 0) {
+            current = {offset, 0, 0, 0, 0, timestamp_ms, timestamp_ms};
+        }
+        current.length += static_cast<uint32_t>(length);
+        current.levels |= static_cast<uint8_t>(1u << (level - 1));
+        current.min_ms = std::min(current.min_ms, timestamp_ms);
+        current.max_ms = std::max(current.max_ms, timestamp_ms);
+        if (++current.records == BLOCK_RECORDS) {
+            close_block();
+        }
+    }
+
+    void close_block() {
+        if (current.records > 0) {
+            blocks.push_back(current);
+            current.records = 0;
+        }
+    }
+
+    void reset() {
+        blocks.clear();
+        current.records = 0;
+    }
+};
+
+// 日志文件（含 .N.gz 历史代）对应的索引路径
+inline std::string path_for(std::string_view log_path) {
+    if (log_path.ends_with(".gz")) {
+        log_path.remove_suffix(3);
+    }
+    std::string result(log_path);
+    result += FILE_SUFFIX;
+    return result;
+}
+
+// 读取索引，按偏移排序并丢弃重叠或超出 file_size 的条目（file_size 未知时传 UINT64_MAX）
+inline std::vector<Entry> load(const std::string& path, uint64_t file_size) {
+    std::vector<Entry> entries;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return entries;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Entry))) {
+        entries.resize(static_cast<size_t>(st.st_size) / sizeof(Entry));
+        size_t want = entries.size() * sizeof(Entry);
+        size_t total = 0;
+        while (total < want) {
+            ssize_t n = pread(fd, reinterpret_cast<char*>(entries.data()) + total, want - total, static_cast<off_t>(total));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            total += static_cast<size_t>(n);
+        }
+        entries.resize(total / sizeof(Entry));  // 忽略写了一半的末尾条目
+    }
+    close(fd);
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.offset < b.offset; });
+    uint64_t end = 0;
+    size_t kept = 0;
+    for (const auto& entry : entries) {
+        if (entry.offset >= end && entry.records > 0 && entry.offset + entry.length <= file_size) {
+            entries[kept++] = entry;
+            end = entry.offset + entry.length;
+        }
+    }
+    entries.resize(kept);
+    return entries;
+}
+
+} // namespace logindex
+
+// 判断是否为日志文件（含轮换产生的历史文件）:
+//   NAME.log / NAME.blog, 以及 .old / .N / .N.gz / .N.gz.tmp 后缀
+[[nodiscard]] inline bool is_log_file_name(std::string_view filename, bool* rotated = nullptr) {
+    std::string_view base = filename;
+    bool is_rotated = false;
+
+    if (base.ends_with(".tmp")) {
+        base.remove_suffix(4);
+        is_rotated = true;
+    }
+    if (base.ends_with(".gz")) {
+        base.remove_suffix(3);
+        is_rotated = true;
+    }
+    if (base.ends_with(".old")) {
+        base.remove_suffix(4);
+        is_rotated = true;
+    } else {
+        size_t digits = 0;
+        while (digits < base.size() && base[base.size() - 1 - digits] >= '0' && base[base.size() - 1 - digits] <= '9') {
+            ++digits;
+        }
+        if (digits > 0 && digits < base.size() && base[base.size() - 1 - digits] == '.') {
+            base.remove_suffix(digits + 1);
+            is_rotated = true;
+        }
+    }
+
+    bool is_log = (base.size() > 4 && base.ends_with(".log")) ||
+                  (base.size() > 5 && base.ends_with(binlog::FILE_SUFFIX));
+    if (rotated) {
+        *rotated = is_rotated;
+    }
+    return is_log;
+}
+
+// 判断是否为日志文件的侧边索引: NAME.log.idx / NAME.log.N.idx
+[[nodiscard]] inline bool is_index_file_name(std::string_view filename) {
+    if (!filename.ends_with(logindex::FILE_SUFFIX)) {
+        return false;
+    }
+    filename.remove_suffix(strlen(logindex::FILE_SUFFIX));
+    return is_log_file_name(filename);
+}
+
+// 第 generation 代历史日志的路径
+[[nodiscard]] inline std::string generation_path(const std::string& path, unsigned generation, bool compressed) {
+    std::string result = path;
+    result += '.';
+    result += std::to_string(generation);
+    if (compressed) {
+        result += ".gz";
+    }
+    return result;
+}
+
+// 日志轮换管理 - 保留多代历史，较旧的代由后台低优先级线程压缩
+//   NAME.log -> NAME.log.1 -> NAME.log.2.gz -> ... -> NAME.log.N.gz
+// 刷新路径只做重命名，压缩和目录容量控制都在后台线程完成
+class RotationManager {
+public:
+    ~RotationManager() {
+        stop();
+    }
+
+    void set_log_dir(std::string dir) {
+        log_dir = std::move(dir);
+    }
+
+    // 设置保留的历史代数
+    void set_generations(unsigned count) {
+        generations.store(std::max(1u, count), std::memory_order_relaxed);
+    }
+
+    // 设置日志目录总大小上限（字节，0 表示不限制）
+    void set_dir_budget(size_t bytes) {
+        dir_budget.store(bytes, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] unsigned generation_count() const noexcept {
+        return generations.load(std::memory_order_relaxed);
+    }
+
+    // 已执行的轮换次数
+    [[nodiscard]] uint64_t rotation_count() const noexcept {
+        return rotations.load(std::memory_order_relaxed);
+    }
+
+    // 轮换日志文件，调用方需已关闭该文件
+    void rotate(const std::string& path) {
+        rotations.fetch_add(1, std::memory_order_relaxed);
+        unsigned count = generations.load(std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(rename_mutex);
+
+            // 删除最旧的一代，其余依次后移，索引随日志一起移动
+            remove(generation_path(path, count, true).c_str());
+            remove(generation_path(path, count, false).c_str());
+            remove(logindex::path_for(generation_path(path, count, false)).c_str());
+            for (unsigned generation = count - 1; generation >= 1; --generation) {
+                bool moved = false;
+                for (bool compressed : {true, false}) {
+                    std::string from = generation_path(path, generation, compressed);
+                    if (access(from.c_str(), F_OK) == 0) {
+                        rename(from.c_str(), generation_path(path, generation + 1, compressed).c_str());
+                        moved = true;
+                    }
+                }
+                std::string index = logindex::path_for(generation_path(path, generation, false));
+                if (!moved || rename(index.c_str(), logindex::path_for(generation_path(path, generation + 1, false)).c_str()) != 0) {
+                    remove(index.c_str());
+                }
+            }
+
+            std::string first = generation_path(path, 1, false);
+            if (access(path.c_str(), F_OK) == 0 && rename(path.c_str(), first.c_str()) != 0) {
+                std::cerr << "Cannot rename file during log rotation: " << path << " -> " << first << " (" << strerror(errno) << ")" << std::endl;
+            }
+            rename(logindex::path_for(path).c_str(), logindex::path_for(first).c_str());
+        }
+
+        // 交给后台线程压缩和清理
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            if (std::find(pending.begin(), pending.end(), path) == pending.end()) {
+                pending.push_back(path);
+            }
+            if (!worker.joinable() && !stopping) {
+                worker = std::thread(&RotationManager::worker_func, this);
+            }
+        }
+        queue_cv.notify_one();
+    }
+
+    // 停止后台线程，未完成的压缩在下次轮换时继续
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stopping = true;
+        }
+        queue_cv.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+private:
+    std::string log_dir;
+    std::atomic<unsigned> generations{5};
+    std::atomic<size_t> dir_budget{8 * 1024 * 1024};
+    std::atomic<uint64_t> rotations{0};
+
+    // 重命名与删除互斥，保证压缩线程替换文件时目标未被后移
+    std::mutex rename_mutex;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::vector<std::string> pending;
+    bool stopping{false};
+    std::thread worker;
+
+    void worker_func() {
+        // 后台线程使用最低优先级，不与刷新路径争抢 CPU
+        setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), 19);
+
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        while (true) {
+            queue_cv.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (stopping) {
+                break;
+            }
+
+            std::vector<std::string> paths;
+            paths.swap(pending);
+            lock.unlock();
+
+            for (const auto& path : paths) {
+                compress_generations(path);
+            }
+            enforce_budget();
+
+            lock.lock();
+        }
+    }
+
+    // 压缩第 2 代及以后的未压缩历史文件
+    void compress_generations(const std::string& path) {
+        unsigned count = generations.load(std::memory_order_relaxed);
+        for (unsigned generation = 2; generation <= count; ++generation) {
+            std::string source = generation_path(path, generation, false);
+            int fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+
+            struct stat source_stat;
+            std::string target = generation_path(path, generation, true);
+            std::string temp = target + ".tmp";
+            bool compressed = fstat(fd, &source_stat) == 0 && gzip_file(fd, temp);
+            close(fd);
+            if (!compressed) {
+                remove(temp.c_str());
+                continue;
+            }
+
+            // 压缩期间文件可能已被再次轮换，确认仍是同一文件后再替换
+            std::lock_guard<std::mutex> lock(rename_mutex);
+            struct stat current_stat;
+            if (stat(source.c_str(), &current_stat) == 0 && current_stat.st_ino == source_stat.st_ino &&
+                rename(temp.c_str(), target.c_str()) == 0) {
+                // 保留原修改时间，容量控制按日志的实际新旧淘汰
+                struct timespec times[2] = {source_stat.st_atim, source_stat.st_mtim};
+                utimensat(AT_FDCWD, target.c_str(), times, 0);
+                remove(source.c_str());
+            } else {
+                remove(temp.c_str());
+            }
+        }
+    }
+
+    // 使用 gzip 压缩文件
+    static bool gzip_file(int source_fd, const std::string& target) {
+        gzFile out = gzopen(target.c_str(), "wb6");
+        if (!out) {
+            return false;
+        }
+
+        std::vector<char> buffer(65536);
+        bool ok = true;
+        while (ok) {
+            ssize_t n = read(source_fd, buffer.data(), buffer.size());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ok = false;
+            } else if (n == 0) {
+                break;
+            } else if (gzwrite(out, buffer.data(), static_cast<unsigned>(n)) != n) {
+                ok = false;
+            }
+        }
+        return gzclose(out) == Z_OK && ok;
+    }
+
+    // 目录超出容量时按修改时间从旧到新删除历史文件，当前日志不会被删除
+    void enforce_budget() {
+        size_t budget = dir_budget.load(std::memory_order_relaxed);
+        if (budget == 0) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(rename_mutex);
+        DIR* dir = opendir(log_dir.c_str());
+        if (!dir) {
+            return;
+        }
+
+        struct Candidate {
+            std::string path;
+            struct timespec mtime;
+            size_t size;
+        };
+        std::vector<Candidate> candidates;
+        size_t total = 0;
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            bool rotated = false;
+            if (!is_log_file_name(entry->d_name, &rotated)) {
+                continue;
+            }
+            std::string full_path = log_dir + "/" + entry->d_name;
+            struct stat st;
+            if (stat(full_path.c_str(), &st) != 0) {
+                continue;
+            }
+            total += static_cast<size_t>(st.st_size);
+            if (rotated) {
+                candidates.push_back({std::move(full_path), st.st_mtim, static_cast<size_t>(st.st_size)});
+            }
+        }
+        closedir(dir);
+
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            if (a.mtime.tv_sec != b.mtime.tv_sec) {
+                return a.mtime.tv_sec < b.mtime.tv_sec;
+            }
+            return a.mtime.tv_nsec < b.mtime.tv_nsec;
+        });
+        for (const auto& candidate : candidates) {
+            if (total <= budget) {
+                break;
+            }
+            if (remove(candidate.path.c_str()) == 0) {
+                total -= candidate.size;
+                remove(logindex::path_for(candidate.path).c_str());
+            }
+        }
+    }
+};
+
+// 内存映射日志段 - 预分配固定大小的文件并映射到内存
+// 生产者通过原子偏移预留空间后直接拷贝到映射区，由内核负责回写
+class MappedSegment {
+public:
+    MappedSegment(std::string path, size_t capacity, RotationManager& rotation)
+        : path(std::move(path))
+        , capacity(capacity)
+        , rotation(rotation) {}
+
+    ~MappedSegment() {
+        close_segment();
+    }
+
+    MappedSegment(const MappedSegment&) = delete;
+    MappedSegment& operator=(const MappedSegment&) = delete;
+
+    // 打开并映射日志段，已有文件从实际内容末尾继续追加
+    bool open_segment() {
+        std::unique_lock<std::shared_mutex> lock(segment_mutex);
+        return open_locked();
+    }
+
+    // 同步并解除映射，文件截断为实际写入长度
+    void close_segment() {
+        std::unique_lock<std::shared_mutex> lock(segment_mutex);
+        close_locked();
+    }
+
+    // 预留 length 字节并由 writer 直接写入映射区，空间不足时轮换后重试
+    template <typename Writer>
+    bool append(size_t length, Writer&& writer) {
+        if (length > capacity) {
+            return false;
+        }
+
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            uint64_t seen_generation;
+            {
+                std::shared_lock<std::shared_mutex> lock(segment_mutex);
+                if (!data) {
+                    return false;
+                }
+                seen_generation = generation;
+
+                size_t offset = reserved.fetch_add(length, std::memory_order_relaxed);
+                if (offset + length <= capacity) {
+                    writer(data + offset);
+                    committed.fetch_add(length, std::memory_order_release);
+                    return true;
+                }
+            }
+            roll(seen_generation);
+        }
+        return false;
+    }
+
+    // 追加完整的文本行（刷新线程写出缓冲的记录时使用），按行拆分为不超过段大小的片段，
+    // 单行超过段大小时截断。段未打开时先重新打开，仍然失败返回 false
+    bool append_lines(std::string_view text) {
+        bool ok = true;
+        while (!text.empty()) {
+            std::string_view piece = text.substr(0, capacity);
+            std::string truncated;
+            if (piece.size() < text.size()) {
+                size_t line_end = piece.rfind('\n');
+                if (line_end != std::string_view::npos) {
+                    piece = piece.substr(0, line_end + 1);
+                } else {
+                    truncated.assign(piece.substr(0, capacity - 1));
+                    truncated += '\n';
+                    piece = truncated;
+                    line_end = text.find('\n');
+                    text.remove_prefix(line_end == std::string_view::npos ? text.size() : line_end + 1);
+                }
+            }
+            if (truncated.empty()) {
+                text.remove_prefix(piece.size());
+            }
+            auto copy = [&](char* dst) { std::memcpy(dst, piece.data(), piece.size()); };
+            if (!append(piece.size(), copy) && !(open_segment() && append(piece.size(), copy))) {
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    // 标记需要同步到存储
+    void request_sync() noexcept {
+        sync_pending.store(true, std::memory_order_relaxed);
+    }
+
+    // 如有需要则同步映射区
+    void sync_if_requested() {
+        if (!sync_pending.exchange(false, std::memory_order_relaxed)) {
+            return;
+        }
+        std::shared_lock<std::shared_mutex> lock(segment_mutex);
+        if (data) {
+            msync(data, committed.load(std::memory_order_acquire), MS_SYNC);
+        }
+    }
+
+    // 去掉末尾填充零后的文件长度，也用于读取正在映射的段
+    static size_t content_length(int fd, size_t size) {
+        char block[4096];
+        while (size > 0) {
+            size_t length = std::min(size, sizeof(block));
+            size_t start = size - length;
+            if (pread(fd, block, length, static_cast<off_t>(start)) != static_cast<ssize_t>(length)) {
+                break;
+            }
+            while (length > 0 && block[length - 1] == '\0') {
+                --length;
+            }
+            if (length > 0) {
+                return start + length;
+            }
+            size = start;
+        }
+        return size;
+    }
+
+private:
+    std::string path;
+    size_t capacity;
+    RotationManager& rotation;
+
+    // 共享锁：生产者写入；独占锁：打开、关闭、轮换
+    std::shared_mutex segment_mutex;
+    int fd{-1};
+    char* data{nullptr};
+    uint64_t generation{0};
+    std::atomic<size_t> reserved{0};
+    std::atomic<size_t> committed{0};
+    std::atomic_bool sync_pending{false};
+
+    bool open_locked() {
+        if (data) {
+            return true;
+        }
+
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Cannot open log segment: " << path << " (" << strerror(errno) << ")" << std::endl;
+            return false;
+        }
+
+        struct stat st;
+        size_t existing = 0;
+        if (fstat(fd, &st) == 0) {
+            existing = static_cast<size_t>(st.st_size);
+        }
+
+        // 上次异常退出时文件未截断，仍是预分配的大小：先跳过末尾的填充零得到实际内容长度
+        size_t content = content_length(fd, existing);
+        if (content < existing && ftruncate(fd, static_cast<off_t>(content)) == 0) {
+            existing = content;
+        }
+
+        // 旧文件已超出段大小，先按常规方式轮换
+        if (existing >= capacity) {
+            close(fd);
+            fd = -1;
+            rotation.rotate(path);
+            return open_locked();
+        }
+
+        // 预分配整个段，避免写入映射区时因空间不足触发 SIGBUS
+        if (fallocate(fd, 0, 0, static_cast<off_t>(capacity)) != 0 &&
+            ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+            std::cerr << "Cannot preallocate log segment: " << path << " (" << strerror(errno) << ")" << std::endl;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+
+        void* mapping = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Cannot map log segment: " << path << " (" << strerror(errno) << ")" << std::endl;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        data = static_cast<char*>(mapping);
+
+        reserved.store(existing, std::memory_order_relaxed);
+        committed.store(existing, std::memory_order_relaxed);
+        ++generation;
+        return true;
+    }
+
+    void close_locked() {
+        if (!data) {
+            return;
+        }
+
+        size_t used = committed.load(std::memory_order_acquire);
+        msync(data, used, MS_SYNC);
+        munmap(data, capacity);
+        data = nullptr;
+
+        if (ftruncate(fd, static_cast<off_t>(used)) != 0) {
+            std::cerr << "Cannot truncate log segment: " << path << " (" << strerror(errno) << ")" << std::endl;
+        }
+        close(fd);
+        fd = -1;
+    }
+
+    // 当前段已满：与缓冲写入相同的方式轮换
+    void roll(uint64_t seen_generation) {
+        std::unique_lock<std::shared_mutex> lock(segment_mutex);
+        if (generation != seen_generation || !data) {
+            return; // 已被其他线程轮换
+        }
+
+        close_locked();
+        rotation.rotate(path);
+        open_locked();
+    }
+};
+
+// 未刷新记录的日志 - 文件映射的环形区，由 Logger 的 journal_mutex 保护
+// 记录入队时写入这里，所属缓冲区刷新后标记为已落盘。映射区位于页缓存中，
+// 进程被杀死（包括 OOM）后内容仍在，下次启动时把未落盘的记录补写到各自的日志。
+//   文件头: magic, 容量, head(最旧的未落盘记录), tail(写入位置)
+//   记录:   EntryHeader + 日志名 + 标签 + 内容，按 8 字节对齐；size 为 0 表示回绕到开头
+class RecordJournal {
+public:
+    struct Recovered {
+        std::chrono::system_clock::time_point timestamp;
+        LogLevel level;
+        std::string_view name;
+        std::string_view tag;
+        std::string_view message;
+        bool deferred;
+    };
+
+    RecordJournal(std::string path, size_t capacity)
+        : path(std::move(path))
+        , capacity(static_cast<uint32_t>(std::max<size_t>(capacity & ~size_t{7}, 4096))) {}
+
+    ~RecordJournal() {
+        if (data) {
+            munmap(data, capacity);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    RecordJournal(const RecordJournal&) = delete;
+    RecordJournal& operator=(const RecordJournal&) = delete;
+
+    // 打开并映射日志文件，已被其他进程使用时失败
+    bool open_journal() {
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            std::cerr << "Cannot open record journal: " << path << " (" << strerror(errno) << ")" << std::endl;
+            return false;
+        }
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            std::cerr << "Record journal is in use by another process: " << path << std::endl;
+            return false;
+        }
+
+        // 保留上次的内容以便恢复，容量变化时按原容量映射，恢复后再调整
+        struct stat st;
+        uint32_t mapped = capacity;
+        if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Header))) {
+            Header old{};
+            if (pread(fd, &old, sizeof(old), 0) == static_cast<ssize_t>(sizeof(old)) && valid_header(old) &&
+                old.capacity <= static_cast<uint64_t>(st.st_size)) {
+                mapped = old.capacity;
+            }
+        }
+        if (static_cast<uint64_t>(st.st_size) < mapped &&
+            fallocate(fd, 0, 0, static_cast<off_t>(mapped)) != 0 && ftruncate(fd, static_cast<off_t>(mapped)) != 0) {
+            std::cerr << "Cannot preallocate record journal: " << path << " (" << strerror(errno) << ")" << std::endl;
+            return false;
+        }
+        void* mapping = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Cannot map record journal: " << path << " (" << strerror(errno) << ")" << std::endl;
+            return false;
+        }
+        data = static_cast<char*>(mapping);
+        configured_capacity = capacity;
+        capacity = mapped;
+        if (!valid_header(header())) {
+            header() = {};
+            std::memcpy(header().magic, MAGIC, sizeof(MAGIC));
+            header().capacity = capacity;
+            header().head = header().tail = DATA_START;
+        }
+        return true;
+    }
+
+    // 依次交给 callback 上次未落盘的记录，记录内容在 reset() 之前有效
+    template <typename Callback>
+    size_t recover(Callback&& callback) {
+        size_t count = 0;
+        uint32_t pos = header().head;
+        uint32_t tail = header().tail;
+        // tail 不在记录边界上时永远走不到它：越过 tail、多余的回绕或遍历超过一圈都视为损坏
+        bool before_wrap = tail < pos;
+        size_t walked = 0;
+        while (pos != tail) {
+            if (walked > capacity || (!before_wrap && pos > tail) || (!before_wrap && wraps_at(pos))) {
+                std::cerr << "Record journal is corrupt, recovery stopped at offset " << pos << std::endl;
+                break;
+            }
+            if (wraps_at(pos)) {
+                walked += capacity - pos;
+                before_wrap = false;
+                pos = DATA_START;
+                continue;
+            }
+            const EntryHeader& entry = entry_at(pos);
+            if (entry.size < sizeof(EntryHeader) + entry.name_len + entry.tag_len + entry.message_len ||
+                entry.size % 8 != 0 || entry.size > capacity - pos) {
+                std::cerr << "Record journal is corrupt, recovery stopped at offset " << pos << std::endl;
+                break;
+            }
+            if (entry.state == STATE_PENDING && entry.level >= LOG_ERROR && entry.level <= LOG_DEBUG) {
+                const char* text = data + pos + sizeof(EntryHeader);
+                callback(Recovered{std::chrono::system_clock::time_point(std::chrono::microseconds(entry.timestamp_us)),
+                                   static_cast<LogLevel>(entry.level),
+                                   std::string_view(text, entry.name_len),
+                                   std::string_view(text + entry.name_len, entry.tag_len),
+                                   std::string_view(text + entry.name_len + entry.tag_len, entry.message_len),
+                                   (entry.flags & FLAG_DEFERRED) != 0});
+                ++count;
+            }
+            pos += entry.size;
+            walked += entry.size;
+        }
+        return count;
+    }
+
+    // 恢复的记录落盘后清空日志，并切换到配置的容量
+    void reset() {
+        if (!data) {
+            return;
+        }
+        header().head = header().tail = DATA_START;
+        if (configured_capacity == capacity) {
+            return;
+        }
+        munmap(data, capacity);
+        capacity = configured_capacity;
+        void* mapping = MAP_FAILED;
+        if (ftruncate(fd, static_cast<off_t>(capacity)) == 0) {
+            mapping = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Cannot resize record journal: " << path << " (" << strerror(errno) << ")" << std::endl;
+            data = nullptr;
+            return;
+        }
+        data = static_cast<char*>(mapping);
+        header().capacity = capacity;
+        header().head = header().tail = DATA_START;
+    }
+
+    // 记录是否小到可以放入日志（不超过容量的四分之一）
+    [[nodiscard]] bool can_hold(size_t name_size, size_t tag_size, size_t message_size) const noexcept {
+        return data && name_size <= UINT16_MAX && tag_size <= UINT16_MAX &&
+               entry_size(name_size + tag_size + message_size) <= (capacity - DATA_START) / 4;
+    }
+
+    // 记录一条待落盘的记录，返回其位置；空间不足时返回 false
+    bool append(std::chrono::system_clock::time_point timestamp, LogLevel level, std::string_view name,
+                std::string_view tag, std::string_view message, bool deferred, uint32_t& offset) {
+        if (!can_hold(name.size(), tag.size(), message.size())) {
+            return false;
+        }
+        auto size = static_cast<uint32_t>(entry_size(name.size() + tag.size() + message.size()));
+
+        uint32_t head = header().head;
+        uint32_t tail = header().tail;
+        if (head == tail) {
+            head = tail = DATA_START;  // 为空时从头开始，避免在末尾处回绕
+            header().head = head;
+        }
+        if (tail >= head) {
+            if (capacity - tail < size) {
+                if (head - DATA_START <= size) {
+                    return false;
+                }
+                if (capacity - tail >= sizeof(EntryHeader)) {
+                    entry_at(tail).size = 0;
+                }
+                tail = DATA_START;
+            }
+        } else if (head - tail <= size) {
+            return false;
+        }
+
+        auto& entry = entry_at(tail);
+        entry = {size, STATE_PENDING, static_cast<uint8_t>(level), static_cast<uint16_t>(name.size()),
+                 static_cast<uint16_t>(tag.size()), static_cast<uint16_t>(deferred ? FLAG_DEFERRED : 0),
+                 static_cast<uint32_t>(message.size()),
+                 std::chrono::duration_cast<std::chrono::microseconds>(timestamp.time_since_epoch()).count()};
+        char* text = data + tail + sizeof(EntryHeader);
+        std::memcpy(text, name.data(), name.size());
+        std::memcpy(text + name.size(), tag.data(), tag.size());
+        std::memcpy(text + name.size() + tag.size(), message.data(), message.size());
+
+        // 内容写完后再移动 tail，进程在中途被杀死时这条记录不可见
+        offset = tail;
+        std::atomic_ref<uint32_t>(header().tail).store(tail + size, std::memory_order_release);
+        return true;
+    }
+
+    // 标记记录已落盘，并跳过开头连续的已落盘记录
+    void release(const std::vector<uint32_t>& offsets) {
+        if (!data) {
+            return;
+        }
+        for (uint32_t offset : offsets) {
+            entry_at(offset).state = STATE_FLUSHED;
+        }
+        uint32_t head = header().head;
+        uint32_t tail = header().tail;
+        while (head != tail) {
+            if (wraps_at(head)) {
+                head = DATA_START;
+            } else if (entry_at(head).state == STATE_FLUSHED) {
+                head += entry_at(head).size;
+            } else {
+                break;
+            }
+        }
+        std::atomic_ref<uint32_t>(header().head).store(head, std::memory_order_release);
+    }
+
+    // 最旧的未落盘记录所属的日志名，日志为空时返回空
+    [[nodiscard]] std::string_view oldest_name() const {
+        uint32_t head = header().head;
+        if (!data || head == header().tail) {
+            return {};
+        }
+        if (wraps_at(head)) {
+            head = DATA_START;
+        }
+        return std::string_view(data + head + sizeof(EntryHeader), entry_at(head).name_len);
+    }
+
+    // 用量超过可用空间的四分之三
+    [[nodiscard]] bool under_pressure() const noexcept {
+        return used() >= (capacity - DATA_START) / 4 * 3;
+    }
+
+    // 当前占用的字节数
+    [[nodiscard]] size_t used() const noexcept {
+        if (!data) {
+            return 0;
+        }
+        uint32_t head = header().head;
+        uint32_t tail = header().tail;
+        return tail >= head ? tail - head : capacity - head + tail - DATA_START;
+    }
+
+private:
+    static constexpr char MAGIC[8] = {'A', 'M', 'L', 'J', 1, 0, 0, 0};
+    static constexpr uint8_t STATE_PENDING = 1;
+    static constexpr uint8_t STATE_FLUSHED = 2;
+    static constexpr uint16_t FLAG_DEFERRED = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t capacity;
+        uint32_t head;
+        uint32_t tail;
+        uint32_t reserved;
+    };
+    static constexpr uint32_t DATA_START = 64;
+
+    struct EntryHeader {
+        uint32_t size;  // 含对齐填充的总长度，0 表示回绕
+        uint8_t state;
+        uint8_t level;
+        uint16_t name_len;
+        uint16_t tag_len;
+        uint16_t flags;
+        uint32_t message_len;
+        int64_t timestamp_us;
+    };
+    static_assert(sizeof(EntryHeader) == 24 && sizeof(Header) <= DATA_START, "journal layout");
+
+    std::string path;
+    uint32_t capacity;
+    uint32_t configured_capacity{0};
+    int fd{-1};
+    char* data{nullptr};
+
+    Header& header() const {
+        return *reinterpret_cast<Header*>(data);
+    }
+
+    static size_t entry_size(size_t text_size) noexcept {
+        return (sizeof(EntryHeader) + text_size + 7) & ~size_t{7};
+    }
+
+    EntryHeader& entry_at(uint32_t offset) const {
+        return *reinterpret_cast<EntryHeader*>(data + offset);
+    }
+
+    // 剩余空间放不下记录头，或遇到回绕标记
+    bool wraps_at(uint32_t offset) const {
+        return capacity - offset < sizeof(EntryHeader) || entry_at(offset).size == 0;
+    }
+
+    bool valid_header(const Header& candidate) const {
+        return std::memcmp(candidate.magic, MAGIC, sizeof(MAGIC)) == 0 && candidate.capacity % 8 == 0 &&
+               candidate.capacity > DATA_START && candidate.head >= DATA_START && candidate.head <= candidate.capacity &&
+               candidate.tail >= DATA_START && candidate.tail <= candidate.capacity &&
+               candidate.head % 8 == 0 && candidate.tail % 8 == 0;
+    }
+};
+
+// 令牌桶参数：每秒 rate 条，最多积累 burst 条；rate 为 0 表示不限制
+struct RateLimit {
+    double rate{0};
+    double burst{0};
+};
+
+// 单个日志的限流与重复抑制，仅由刷新线程在持有 log_mutex 时使用。
+// 每个级别一个令牌桶，按记录自身的时间戳补充令牌；与最近若干条不同消息之一相同的记录只计数，
+// 重复结束（出现新消息）时在新消息之前输出重复次数，被限流的条数在刷新时输出
+class RecordFilter {
+public:
+    using Clock = std::chrono::system_clock;
+    static constexpr size_t RECENT = 8;          // 参与重复判断的最近消息数
+    static constexpr size_t SUMMARY_TEXT = 120;  // 摘要中引用的消息长度
+
+    void configure(const std::array<RateLimit, 4>& limits, bool dedup) {
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            buckets[i].limit = limits[i];
+            buckets[i].tokens = limits[i].burst;
+        }
+        dedup_enabled = dedup;
+    }
+
+    // 返回 false 表示记录被抑制；deferred 表示 message 为延迟格式化的内容。
+    // 结束的重复以 emit(level, text) 输出，调用方应把它们写在本条记录之前
+    template <typename Emit>
+    bool admit(Clock::time_point timestamp, LogLevel level, std::string_view tag, std::string_view message,
+               bool deferred, Emit&& emit) {
+        if (dedup_enabled) {
+            uint64_t hash = hash_record(level, tag, message);
+            for (size_t i = 0; i < recent_count; ++i) {
+                Recent& entry = recent[i];
+                if (entry.hash == hash && entry.level == level && entry.deferred == deferred && entry.message == message) {
+                    ++entry.repeats;
+                    has_pending = true;
+                    return false;
+                }
+            }
+            emit_repeats(emit);
+            Recent& slot = recent[recent_count < RECENT ? recent_count++ : next_slot];
+            next_slot = (next_slot + 1) % RECENT;
+            slot.hash = hash;
+            slot.level = level;
+            slot.deferred = deferred;
+            slot.repeats = 0;
+            slot.message.assign(message);
+        }
+
+        Bucket& bucket = buckets[static_cast<size_t>(level) - 1];
+        if (bucket.limit.rate <= 0) {
+            return true;
+        }
+        // 多个生产者的时间戳可能略有交错，时间倒退时不补充
+        if (bucket.last != Clock::time_point{} && timestamp > bucket.last) {
+            double elapsed = std::chrono::duration<double>(timestamp - bucket.last).count();
+            bucket.tokens = std::min(bucket.limit.burst, bucket.tokens + elapsed * bucket.limit.rate);
+        }
+        bucket.last = std::max(bucket.last, timestamp);
+        if (bucket.tokens >= 1) {
+            bucket.tokens -= 1;
+            return true;
+        }
+        ++bucket.suppressed;
+        has_pending = true;
+        return false;
+    }
+
+    [[nodiscard]] bool pending() const noexcept { return has_pending; }
+
+    // 输出摘要 emit(level, text)，并开始新的统计窗口
+    template <typename Emit>
+    void summarize(Emit&& emit) {
+        if (!has_pending && recent_count == 0) {
+            return;
+        }
+        emit_repeats(emit);
+        recent_count = 0;
+        next_slot = 0;
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            if (buckets[i].suppressed > 0) {
+                emit(LOG_WARN, "Rate limit exceeded, suppressed " + std::to_string(buckets[i].suppressed) + " " +
+                                   get_level_string(static_cast<LogLevel>(i + 1)) + " records");
+                buckets[i].suppressed = 0;
+            }
+        }
+        has_pending = false;
+    }
+
+private:
+    struct Bucket {
+        RateLimit limit;
+        double tokens{0};
+        Clock::time_point last{};
+        uint64_t suppressed{0};
+    };
+
+    struct Recent {
+        uint64_t hash{0};
+        LogLevel level{LOG_INFO};
+        bool deferred{false};
+        uint32_t repeats{0};
+        std::string message;
+    };
+
+    // FNV-1a
+    static uint64_t hash_record(LogLevel level, std::string_view tag, std::string_view message) noexcept {
+        uint64_t hash = 1469598103934665603ULL ^ static_cast<uint64_t>(level);
+        for (std::string_view part : {tag, message}) {
+            for (unsigned char c : part) {
+                hash = (hash ^ c) * 1099511628211ULL;
+            }
+            hash = (hash ^ 0xff) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // 摘要中引用的消息，延迟格式化的内容先生成文本
+    static std::string summary_text(const Recent& entry) {
+        if (!entry.deferred) {
+            return entry.message.substr(0, SUMMARY_TEXT);
+        }
+        std::string text;
+        deferred::render(text, entry.message);
+        text.resize(std::min(text.size(), SUMMARY_TEXT));
+        return text;
+    }
+
+    static std::string repeat_text(uint32_t repeats, std::string_view message) {
+        return "Message repeated " + std::to_string(repeats) + " times: " + std::string(message);
+    }
+
+    // 输出并清零窗口内的重复计数
+    template <typename Emit>
+    void emit_repeats(Emit& emit) {
+        if (!has_pending) {
+            return;
+        }
+        for (size_t i = 0; i < recent_count; ++i) {
+            if (recent[i].repeats > 0) {
+                emit(recent[i].level, repeat_text(recent[i].repeats, summary_text(recent[i])));
+                recent[i].repeats = 0;
+            }
+        }
+        has_pending = std::any_of(buckets.begin(), buckets.end(), [](const Bucket& bucket) { return bucket.suppressed > 0; });
+    }
+
+    std::array<Bucket, 4> buckets{};
+    std::array<Recent, RECENT> recent{};
+    size_t recent_count{0};
+    size_t next_slot{0};
+    bool dedup_enabled{false};
+    bool has_pending{false};
+};
+
+// 追加 JSON 字符串字面量
+inline void append_json_string(std::string& out, std::string_view text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// 耗时统计：次数、总和、最大值，以及按 2 的幂划分的微秒级直方图
+class DurationStats {
+public:
+    static constexpr size_t BUCKETS = 24;  // <1us, [1,2)us ... >=4s
+
+    void record(std::chrono::steady_clock::duration duration) {
+        uint64_t us = static_cast<uint64_t>(std::max<int64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(duration).count(), 0));
+        size_t bucket = 0;
+        while (bucket + 1 < BUCKETS && (1ULL << bucket) <= us) {
+            ++bucket;
+        }
+        ++counts[bucket];
+        ++total;
+        sum_us += us;
+        max_us = std::max(max_us, us);
+    }
+
+    // "名称 count=N avg_us=N max_us=N [<1:N 1-2:N ...]"
+    void append_text(std::string& out, std::string_view name) const {
+        out += name;
+        out += " count=" + std::to_string(total) + " total_us=" + std::to_string(sum_us) +
+               " avg_us=" + std::to_string(total ? sum_us / total : 0) + " max_us=" + std::to_string(max_us);
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            if (counts[i] != 0) {
+                out += ' ';
+                out += bucket_label(i);
+                out += ':' + std::to_string(counts[i]);
+            }
+        }
+        out += '\n';
+    }
+
+    void append_json(std::string& out) const {
+        out += "{\"count\":" + std::to_string(total) + ",\"total_us\":" + std::to_string(sum_us) +
+               ",\"max_us\":" + std::to_string(max_us) + ",\"buckets\":{";
+        bool first = true;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            if (counts[i] != 0) {
+                if (!first) out += ',';
+                first = false;
+                append_json_string(out, bucket_label(i));
+                out += ':' + std::to_string(counts[i]);
+            }
+        }
+        out += "}}";
+    }
+
+private:
+    static std::string bucket_label(size_t i) {
+        if (i == 0) return "<1";
+        if (i + 1 == BUCKETS) return ">=" + std::to_string(1ULL << (i - 1));
+        return std::to_string(1ULL << (i - 1)) + "-" + std::to_string(1ULL << i);
+    }
+
+    uint64_t counts[BUCKETS] = {};
+    uint64_t total = 0;
+    uint64_t sum_us = 0;
+    uint64_t max_us = 0;
+};
+
+// io_uring 异步写入队列 - 刷新路径提交写入和同步请求后立即返回，完成事件由等待方或刷新线程收割。
+// 直接使用系统调用，不依赖 liburing。内核不支持、被 seccomp/SELinux 拒绝或缺少所需操作时
+// open_ring 返回 false，调用方继续使用同步 writev。
+// 完成事件通过注册的 eventfd 通知：同一时间只有一个等待方在 mutex 之外阻塞读取 eventfd，
+// 其余等待方等它收割后的通知，提交和非阻塞的收割不必等待阻塞中的一方
+class UringQueue {
+public:
+    // 一个已提交的操作，完成后写入结果（负数为 -errno）并递减 pending
+    struct Request {
+        int result{0};
+        std::atomic<int>* pending{nullptr};
+    };
+
+    enum Completion {
+        COMPLETION_DONE,
+        COMPLETION_PENDING,  // 尚未完成（不等待时）
+        COMPLETION_FAILED,   // 无法再等待完成事件，队列已停用
+    };
+
+    UringQueue() = default;
+    UringQueue(const UringQueue&) = delete;
+    UringQueue& operator=(const UringQueue&) = delete;
+
+    ~UringQueue() {
+        close_ring();
+    }
+
+    // 创建队列并探测所需操作，最后用一个空操作确认提交和收割都未被拦截
+    bool open_ring(unsigned entries) {
+#ifdef AMMF_HAVE_IO_URING
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ring_fd >= 0) {
+            return true;
+        }
+        io_uring_params params{};
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            return false;
+        }
+        ring_fd = fd;
+
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        }
+        sq_ring = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cq_ring = single_mmap ? sq_ring
+                              : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes_map == MAP_FAILED) {
+            if (sqes_map != MAP_FAILED) {
+                munmap(sqes_map, sqes_size);
+            }
+            close_locked();
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqes_map);
+
+        auto* sq = static_cast<char*>(sq_ring);
+        auto* cq = static_cast<char*>(cq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_entries = params.sq_entries;
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        cq_entries = params.cq_entries;
+
+        if (!probe_ops() || !nop_roundtrip()) {
+            close_locked();
+            return false;
+        }
+
+        // 内核需支持 IORING_REGISTER_EVENTFD（5.2+），等待完成时阻塞在 eventfd 上
+        event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd < 0 || syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_EVENTFD, &event_fd, 1) < 0) {
+            close_locked();
+            return false;
+        }
+        return true;
+#else
+        (void)entries;
+        return false;
+#endif
+    }
+
+    void close_ring() {
+        std::lock_guard<std::mutex> lock(mutex);
+        close_locked();
+    }
+
+    [[nodiscard]] bool available() const noexcept {
+        return ring_fd >= 0;
+    }
+
+    // 提交 writev，sync 不为空时链接一个 fdatasync。文件以 O_APPEND 打开，偏移被忽略，写入总在末尾。
+    // 完成队列余量不足或提交失败时返回 false，请求未进入队列
+    bool submit_write(int fd, const iovec* iov, unsigned count, Request& write, Request* sync) {
+#ifdef AMMF_HAVE_IO_URING
+        std::lock_guard<std::mutex> lock(mutex);
+        if (failed) {
+            return false;
+        }
+        unsigned needed = sync ? 2 : 1;
+        if (in_flight + needed > cq_entries) {
+            reap();
+        }
+        unsigned tail = *sq_tail;
+        if (in_flight + needed > cq_entries ||
+            tail - std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire) + needed > sq_entries) {
+            return false;
+        }
+
+        write.pending->store(static_cast<int>(needed), std::memory_order_relaxed);
+        io_uring_sqe& write_sqe = next_sqe(tail);
+        write_sqe.opcode = IORING_OP_WRITEV;
+        write_sqe.fd = fd;
+        write_sqe.addr = reinterpret_cast<uintptr_t>(iov);
+        write_sqe.len = count;
+        write_sqe.user_data = reinterpret_cast<uintptr_t>(&write);
+        if (sync) {
+            // 写入不完整时链接的同步被取消，由收尾方补做
+            write_sqe.flags = IOSQE_IO_LINK;
+            io_uring_sqe& sync_sqe = next_sqe(tail);
+            sync_sqe.opcode = IORING_OP_FSYNC;
+            sync_sqe.fd = fd;
+            sync_sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+            sync_sqe.user_data = reinterpret_cast<uintptr_t>(sync);
+        }
+        std::atomic_ref<unsigned>(*sq_tail).store(tail, std::memory_order_release);
+
+        if (!enter(needed, 0, 0)) {
+            // 内核未取走请求，撤回后由调用方同步写出
+            std::atomic_ref<unsigned>(*sq_tail).store(tail - needed, std::memory_order_release);
+            write.pending->store(0, std::memory_order_relaxed);
+            return false;
+        }
+        in_flight += needed;
+        return true;
+#else
+        (void)fd, (void)iov, (void)count, (void)write, (void)sync;
+        return false;
+#endif
+    }
+
+    // 收割完成事件直到 pending 归零，wait 为 false 时不阻塞。
+    // 等待完成事件失败时返回 COMPLETION_FAILED，之后的提交都会失败，调用方改用同步写入
+    Completion complete(const std::atomic<int>& pending, bool wait) {
+#ifdef AMMF_HAVE_IO_URING
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            reap();
+            if (pending.load(std::memory_order_acquire) == 0) {
+                return COMPLETION_DONE;
+            }
+            if (failed) {
+                return COMPLETION_FAILED;
+            }
+            if (!wait) {
+                return COMPLETION_PENDING;
+            }
+            await(lock, -1);
+        }
+#else
+        (void)pending, (void)wait;
+        return COMPLETION_DONE;
+#endif
+    }
+
+    // 等待任意一个完成事件并收割，最长 timeout_ms 毫秒（负数为一直等待），没有已提交的请求时立即返回
+    void wait_any(int timeout_ms) {
+#ifdef AMMF_HAVE_IO_URING
+        std::unique_lock<std::mutex> lock(mutex);
+        if (in_flight > 0 && !failed) {
+            await(lock, timeout_ms);
+        }
+#else
+        (void)timeout_ms;
+#endif
+    }
+
+private:
+    // 提交和收割都持有，完成事件可能由任何一个等待方收割；阻塞等待 eventfd 时不持有
+    std::mutex mutex;
+    std::condition_variable reaped_cv;  // 阻塞等待的一方收割后通知其余等待方
+    bool waiting{false};                // 已有一方在等待 eventfd
+    bool failed{false};
+    int ring_fd{-1};
+    int event_fd{-1};
+
+#ifdef AMMF_HAVE_IO_URING
+    void* sq_ring{MAP_FAILED};
+    void* cq_ring{MAP_FAILED};
+    size_t sq_size{0};
+    size_t cq_size{0};
+    size_t sqes_size{0};
+    io_uring_sqe* sqes{nullptr};
+    unsigned* sq_head{nullptr};
+    unsigned* sq_tail{nullptr};
+    unsigned* sq_array{nullptr};
+    unsigned sq_mask{0};
+    unsigned sq_entries{0};
+    unsigned* cq_head{nullptr};
+    unsigned* cq_tail{nullptr};
+    io_uring_cqe* cqes{nullptr};
+    unsigned cq_mask{0};
+    unsigned cq_entries{0};
+    unsigned in_flight{0};  // 已提交未收割的请求数，不超过完成队列容量
+
+    // 取得 tail 处的提交项并后移 tail（尚未发布给内核）
+    io_uring_sqe& next_sqe(unsigned& tail) {
+        unsigned index = tail & sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sq_array[index] = index;
+        ++tail;
+        return sqe;
+    }
+
+    bool enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        while (true) {
+            long result = syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+            if (result >= 0) {
+                return true;
+            }
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+    // 等待完成事件后收割（调用方持有 lock）。只有等待 eventfd 的一方读取它，
+    // 其他线程先收割了这一方的请求时 eventfd 仍有计数，不会错过唤醒
+    void await(std::unique_lock<std::mutex>& lock, int timeout_ms) {
+        if (waiting) {
+            if (timeout_ms < 0) {
+                reaped_cv.wait(lock);
+            } else {
+                reaped_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms));
+            }
+            return;
+        }
+        waiting = true;
+        lock.unlock();
+        pollfd pfd{event_fd, POLLIN, 0};
+        bool ok = poll(&pfd, 1, timeout_ms) >= 0 || errno == EINTR;
+        uint64_t count;
+        if (ok && (pfd.revents & POLLIN) && read(event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN &&
+            errno != EINTR) {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Cannot wait for io_uring completions (" << strerror(errno) << ")" << std::endl;
+        }
+        lock.lock();
+        waiting = false;
+        failed = failed || !ok;
+        reap();
+        reaped_cv.notify_all();
+    }
+
+    // 收割所有完成事件（调用方需持有 mutex）
+    void reap() {
+        unsigned head = *cq_head;
+        unsigned tail = std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & cq_mask];
+            if (auto* request = reinterpret_cast<Request*>(static_cast<uintptr_t>(cqe.user_data))) {
+                request->result = cqe.res;
+                request->pending->fetch_sub(1, std::memory_order_release);
+            }
+            if (in_flight > 0) {
+                --in_flight;
+            }
+        }
+        std::atomic_ref<unsigned>(*cq_head).store(head, std::memory_order_release);
+    }
+
+    // 内核需支持 IORING_REGISTER_PROBE（5.6+）且提供写入和同步操作
+    bool probe_ops() {
+        constexpr unsigned PROBE_OPS = 256;
+        std::vector<unsigned char> storage(sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op));
+        auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0) {
+            return false;
+        }
+        for (unsigned op : {IORING_OP_NOP, IORING_OP_WRITEV, IORING_OP_FSYNC}) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 安全策略可能只拦截提交，用空操作走一遍完整流程
+    bool nop_roundtrip() {
+        unsigned tail = *sq_tail;
+        next_sqe(tail).opcode = IORING_OP_NOP;
+        std::atomic_ref<unsigned>(*sq_tail).store(tail, std::memory_order_release);
+        if (!enter(1, 1, IORING_ENTER_GETEVENTS)) {
+            return false;
+        }
+        unsigned head = *cq_head;
+        if (head == std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire)) {
+            return false;
+        }
+        int result = cqes[head & cq_mask].res;
+        std::atomic_ref<unsigned>(*cq_head).store(head + 1, std::memory_order_release);
+        return result == 0;
+    }
+#endif
+
+    void close_locked() {
+#ifdef AMMF_HAVE_IO_URING
+        if (sqes) {
+            munmap(sqes, sqes_size);
+            sqes = nullptr;
+        }
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_size);
+        }
+        if (sq_ring != MAP_FAILED) {
+            munmap(sq_ring, sq_size);
+        }
+        sq_ring = cq_ring = MAP_FAILED;
+        in_flight = 0;
+        if (event_fd >= 0) {
+            close(event_fd);
+            event_fd = -1;
+        }
+#endif
+        if (ring_fd >= 0) {
+            close(ring_fd);
+            ring_fd = -1;
+        }
+    }
+};
+
+// 设备电源状态，读取自 /sys/class/power_supply 和背光亮度
+struct PowerState {
+    bool external{false};       // 接通充电器（或电池处于充电/充满状态）
+    bool screen_on{false};
+    bool screen_known{false};   // 找到了可读的背光亮度
+
+    // 未充电且屏幕熄灭（屏幕状态未知时只看是否充电）时进入低功耗模式
+    [[nodiscard]] bool low_power() const noexcept {
+        return !external && !(screen_known && screen_on);
+    }
+};
+
+// 读取 sysfs 小文件的第一行，失败时返回空
+inline std::string read_sysfs_line(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {};
+    }
+    char text[64];
+    ssize_t length = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (length <= 0) {
+        return {};
+    }
+    std::string line(text, static_cast<size_t>(length));
+    line.erase(std::min(line.find('\n'), line.size()));
+    return line;
+}
+
+inline PowerState read_power_state() {
+    PowerState state;
+    if (DIR* dir = opendir("/sys/class/power_supply")) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            std::string base = std::string("/sys/class/power_supply/") + entry->d_name + "/";
+            std::string type = read_sysfs_line(base + "type");
+            if (type == "Battery") {
+                std::string status = read_sysfs_line(base + "status");
+                state.external |= status == "Charging" || status == "Full";
+            } else if (read_sysfs_line(base + "online") == "1") {
+                state.external = true;  // Mains、USB、Wireless 等供电
+            }
+        }
+        closedir(dir);
+    }
+
+    auto check_brightness = [&state](const std::string& path) {
+        std::string brightness = read_sysfs_line(path);
+        if (!brightness.empty()) {
+            state.screen_known = true;
+            state.screen_on |= brightness != "0";
+        }
+    };
+    if (DIR* dir = opendir("/sys/class/backlight")) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') {
+                check_brightness(std::string("/sys/class/backlight/") + entry->d_name + "/brightness");
+            }
+        }
+        closedir(dir);
+    }
+    if (!state.screen_known) {
+        check_brightness("/sys/class/leds/lcd-backlight/brightness");
+    }
+    return state;
+}
+
+// 高性能、低功耗日志系统
+class Logger {
+public:
+    // 驻留的日志名 id，见 log_id()
+    using LogId = uint32_t;
+    static constexpr LogId INVALID_LOG = UINT32_MAX;
+
+    // 按 string_view 查找名称的哈希，查找不拷贝名称
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const noexcept {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
+
+private:
+    // 使用 string_view 优化字符串处理
+    using StringView = std::string_view;
+    
+    // 使用 steady_clock 获得更好的性能
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+    
+    // 原子变量减少锁竞争
+    std::atomic_bool running{true};
+    std::atomic_bool low_power_mode{false};
+    std::atomic_bool follow_power{false};           // 按设备电源状态切换低功耗模式
+    std::atomic<unsigned int> max_idle_time{30000}; // ms
+    std::atomic<size_t> buffer_max_size{8192};      // bytes
+    std::atomic<size_t> log_size_limit{102400};     // bytes
+    std::atomic<int> log_level{LOG_INFO};           // default level
+
+    // 日志目录
+    std::string log_dir;
+
+    // 互斥锁 - 保证记录按入队顺序出队，并保护崩溃恢复日志的写入和运行统计；
+    // 各日志的缓冲区和文件由各自的锁保护（见 LogState），仅由消费者持有
+    std::mutex log_mutex;
+
+    // 持有 log_mutex，并把持有时间计入统计
+    class MutexHold {
+    public:
+        explicit MutexHold(Logger& owner) : owner(owner), lock(owner.log_mutex), start(Clock::now()) {}
+        ~MutexHold() { owner.mutex_hold.record(Clock::now() - start); }
+
+    private:
+        Logger& owner;
+        std::lock_guard<std::mutex> lock;
+        TimePoint start;
+    };
+
+    // 运行统计 - 除原子计数和 flush_latency 外均由 log_mutex 保护
+    TimePoint started_at{Clock::now()};
+    std::atomic<uint64_t> level_filtered{0};
+    std::atomic<uint64_t> flush_count{0};
+    std::atomic<uint64_t> bytes_written{0};
+    std::mutex latency_mutex;  // 各日志并行刷新，flush_latency 单独加锁
+    DurationStats flush_latency;
+    DurationStats mutex_hold;
+    std::atomic<unsigned> stats_interval{0};  // 秒，0 表示不定期输出
+    TimePoint last_stats_dump{Clock::now()};
+
+    // 刷新线程唤醒 - 与 log_mutex 分离，生产者不会因磁盘 I/O 阻塞
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    bool flush_requested{false};
+    // 刷新线程没有待刷新的缓冲区时为 true，下一条入队的记录负责唤醒它
+    std::atomic_bool wake_on_record{false};
+    // 本轮排空后已有生产者发现队列过半并唤醒过刷新线程，由 drain_ring 清除
+    std::atomic_bool half_full_signaled{false};
+
+    // 自适应刷新 - 批量阈值随写入速率在 [基准, 基准 * MAX_BATCH_FACTOR] 间调整，由 log_mutex 保护
+    static constexpr double BATCH_WINDOW_S = 1.0;  // 阈值约为 1 秒的写入量
+    static constexpr size_t MAX_BATCH_FACTOR = 8;
+    static constexpr auto POWER_CHECK_INTERVAL = std::chrono::seconds(30);
+    size_t batch_size{8192};
+    double write_rate{0};           // 写入缓冲区的字节/秒，指数平均
+    std::atomic<uint64_t> appended_bytes{0};  // 累计写入缓冲区的字节数
+    uint64_t rate_base_bytes{0};
+    TimePoint rate_sampled{Clock::now()};
+    TimePoint power_checked{};
+    uint64_t wakeups{0};
+
+    // 生产者与刷新线程之间的记录队列
+    RecordRing ring;
+    std::atomic<int> overflow_policy{OVERFLOW_BLOCK};
+    std::atomic<uint64_t> dropped_records{0};
+    std::atomic<uint64_t> rejected_records{0};  // 日志数达到 MAX_LOGS 后写给新日志名的记录
+    uint64_t reported_drops{0};
+    uint64_t reported_rejects{0};
+
+    // 限流与重复抑制 - 启动时配置
+    struct RateRule {
+        std::string log_name;  // 为空时匹配所有日志
+        int level;             // 为 0 时匹配所有级别
+        RateLimit limit;
+    };
+    std::vector<RateRule> rate_rules;
+    bool dedup_enabled{false};
+    std::atomic<uint64_t> suppressed_records{0};
+
+    // 日志文件 - 由所属日志的 file_mutex 保护
+    struct LogFile {
+        int fd{-1};
+        int index_fd{-1};  // 侧边索引，随日志文件一起关闭
+        TimePoint last_access;
+        size_t current_size{0};
+
+        ~LogFile() {
+            close_fd();
+        }
+
+        void close_fd() {
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+            if (index_fd >= 0) {
+                close(index_fd);
+                index_fd = -1;
+            }
+        }
+    };
+
+    // 从缓冲区交换出的待写批次，写入期间缓冲区可继续接收记录
+    struct Batch {
+        std::vector<std::string> chunks;
+        size_t size{0};
+        bool has_error{false};
+        logindex::Builder index;
+        std::vector<uint32_t> journal_entries;
+
+        // 异步写入：提交后数据块保持不动，直到持有 file_mutex 的一方收尾（见 finish_batch）
+        bool in_flight{false};
+        std::atomic<int> pending{0};
+        UringQueue::Request write_request;
+        UringQueue::Request sync_request;
+        std::vector<iovec> iov;
+        size_t offset{0};  // 提交时的文件大小，收尾时据此换算索引偏移
+        std::string path;
+        TimePoint submitted;
+    };
+
+    // 优化的缓冲区 - 使用预分配内存
+    // 内容按固定大小分块存放，增长时无需搬移已有数据，刷新时一次 writev 写出
+    struct LogBuffer {
+        static constexpr size_t CHUNK_SIZE = 16384;
+
+        std::vector<std::string> chunks;
+        size_t size{0};
+        TimePoint last_write;
+        bool has_error{false};
+
+        // 时间戳精度
+        TimePrecision precision{TIME_SECONDS};
+
+        // 二进制格式编码状态
+        bool binary{false};
+        binlog::Encoder encoder;
+
+        // 限流与重复抑制
+        RecordFilter filter;
+
+        // 文本日志的索引块
+        logindex::Builder index;
+
+        // 缓冲区中的记录在崩溃恢复日志中的位置
+        std::vector<uint32_t> journal_entries;
+
+        // 运行统计
+        uint64_t records{0};      // 写入缓冲区的记录数
+        uint64_t bytes{0};        // 写入缓冲区的字节数
+        uint64_t suppressed{0};   // 被限流或重复抑制的记录数
+        uint64_t flushes{0};
+        size_t high_water{0};     // 刷新前缓冲区的最大字节数
+
+        LogBuffer() {
+            // 预分配内存减少重新分配
+            chunks.emplace_back().reserve(CHUNK_SIZE); // 初始预分配 16KB
+        }
+
+        // 获取可容纳 needed 字节的末尾数据块
+        std::string& tail(size_t needed) {
+            if (!chunks.back().empty() && chunks.back().size() + needed > CHUNK_SIZE) {
+                chunks.emplace_back().reserve(std::max(CHUNK_SIZE, needed));
+            }
+            return chunks.back();
+        }
+
+        // 清空内容，保留首个数据块的内存
+        void clear() {
+            chunks.resize(1);
+            chunks.front().clear();
+            size = 0;
+            has_error = false;
+            encoder.reset();
+            index.reset();
+        }
+
+        // 把内容交换到（已清空的）批次中，缓冲区换用批次上次留下的数据块
+        void take(Batch& batch) {
+            std::swap(chunks, batch.chunks);
+            std::swap(index, batch.index);
+            std::swap(journal_entries, batch.journal_entries);
+            batch.size = size;
+            batch.has_error = has_error;
+            if (chunks.empty()) {
+                chunks.emplace_back().reserve(CHUNK_SIZE);
+            }
+            clear();
+        }
+    };
+
+    // 单个日志的状态，日志名首次使用时驻留为 id，之后直到 Logger 析构都不会移除。
+    //   buffer_mutex 保护缓冲区，只在追加记录和交换出批次时短暂持有；
+    //   file_mutex 保护文件，写入、同步和轮换期间持有，同一日志的批次按顺序写出。
+    // 不同日志的写入和轮换互不阻塞。加锁顺序：log_mutex → file_mutex → buffer_mutex
+    struct LogState {
+        std::string name;
+        MappedSegment* mapped{nullptr};  // 启用内存映射段时由生产者直接写入
+
+        std::mutex buffer_mutex;
+        LogBuffer buffer;
+
+        std::mutex file_mutex;
+        LogFile file;
+        Batch batch;
+    };
+
+    // 日志名驻留表 - 按名称哈希分片，每片一个读写锁，查找不拷贝名称；
+    // id 是 log_table 的下标，发布后无需加锁即可访问
+    static constexpr size_t REGISTRY_SHARDS = 8;
+    static constexpr uint32_t MAX_LOGS = 1024;
+
+    struct RegistryShard {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, uint32_t, NameHash, std::equal_to<>> ids;
+    };
+    std::array<RegistryShard, REGISTRY_SHARDS> registry;
+    std::mutex create_mutex;  // 新建日志时持有，分配 id
+    std::unique_ptr<std::unique_ptr<LogState>[]> log_table{std::make_unique<std::unique_ptr<LogState>[]>(MAX_LOGS)};
+    std::atomic<uint32_t> log_count{0};
+
+    // 线程控制
+    std::unique_ptr<std::thread> flush_thread;
+
+    // 多代轮换与后台压缩（需在内存映射段之前构造、之后析构）
+    RotationManager rotation;
+
+    // io_uring 异步写入 - 启用后批次提交即返回，未启用或探测失败时同步 writev
+    static constexpr unsigned ASYNC_QUEUE_DEPTH = 64;
+    UringQueue uring;
+    std::atomic_bool async_io{false};
+
+    // 内存映射日志段 - 启动时配置，之后只读，查找无需加锁
+    std::map<std::string, std::unique_ptr<MappedSegment>, std::less<>> mapped_logs;
+
+    // 使用二进制格式的日志 - 启动时配置
+    std::vector<std::string> binary_logs;
+
+    // 未刷新记录的崩溃恢复日志 - 仅守护进程启用，由 journal_mutex 保护（生产者入队时写入，各日志刷新后并行释放记录）
+    std::mutex journal_mutex;
+    std::unique_ptr<RecordJournal> journal;
+    std::atomic_bool journal_enabled{false};
+    std::atomic_bool journal_pressure{false};  // 恢复日志将满，刷新线程应写出持有其记录的缓冲区
+    uint64_t recovered_records{0};
+
+    // 各日志的时间戳精度 - 启动时配置
+    TimePrecision default_precision{TIME_SECONDS};
+    std::vector<std::pair<std::string, TimePrecision>> time_precisions;
+
+public:
+    // 使用 string_view 优化构造函数
+    Logger(StringView dir, int level = LOG_INFO, size_t size_limit = 102400)
+        : log_dir(dir)
+        , log_level(level)
+        , log_size_limit(size_limit) {
+
+        // 创建日志目录
+        create_log_directory();
+        rotation.set_log_dir(log_dir);
+
+        // 启动刷新线程
+        flush_thread = std::make_unique<std::thread>(&Logger::flush_thread_func, this);
+    }
+
+    ~Logger() {
+        stop();
+
+        if (flush_thread && flush_thread->joinable()) {
+            flush_thread->join();
+        }
+    }
+
+    // 停止日志系统
+    void stop() {
+        bool expected = true;
+        if (running.compare_exchange_strong(expected, false, std::memory_order_relaxed)) {
+            request_flush();
+
+            {
+                MutexHold lock(*this);
+                drain_ring();
+                for_each_log([this](LogState& log) {
+                    flush_log(log, true);
+                    std::lock_guard<std::mutex> file_lock(log.file_mutex);
+                    log.file.close_fd();
+                });
+            }
+
+            // 同步并截断内存映射日志段
+            for (auto& segment_pair : mapped_logs) {
+                segment_pair.second->close_segment();
+            }
+
+            rotation.stop();
+        }
+    }
+
+    // 设置最大空闲时间（毫秒）
+    void set_max_idle_time(unsigned int ms) {
+        max_idle_time.store(ms, std::memory_order_relaxed);
+        request_flush();
+    }
+
+    // 设置缓冲区大小（批量阈值的基准）
+    void set_buffer_size(size_t size) {
+        buffer_max_size.store(size, std::memory_order_relaxed);
+        request_flush();
+    }
+
+    // 设置日志级别
+    void set_log_level(int level) {
+        log_level.store(level, std::memory_order_relaxed);
+    }
+
+    // 设置日志文件大小限制
+    void set_log_size_limit(size_t limit) {
+        log_size_limit.store(limit, std::memory_order_relaxed);
+    }
+
+    // 为指定日志启用内存映射段（需在写入日志前调用）
+    bool enable_mapped_log(StringView log_name, size_t segment_size) {
+        std::string log_path = log_dir + "/";
+        log_path += log_name;
+        log_path += ".log";
+
+        auto segment = std::make_unique<MappedSegment>(log_path, segment_size, rotation);
+        if (!segment->open_segment()) {
+            return false;
+        }
+        mapped_logs.insert_or_assign(std::string(log_name), std::move(segment));
+        return true;
+    }
+
+    // 启用 io_uring 异步写入（需在写入日志前调用）：写入和 ERROR 的同步在内核中完成，
+    // 刷新线程提交后即可处理下一个日志。内核不支持或被安全策略拒绝时返回 false，继续使用同步 writev
+    bool enable_async_io() {
+        if (!uring.open_ring(ASYNC_QUEUE_DEPTH)) {
+            return false;
+        }
+        async_io.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // 为指定日志启用二进制格式（需在写入日志前调用）
+    void enable_binary_log(StringView log_name) {
+        binary_logs.emplace_back(log_name);
+    }
+
+    // 设置时间戳精度，log_name 为空时作为默认值（需在写入日志前调用）
+    void set_time_precision(StringView log_name, TimePrecision precision) {
+        if (log_name.empty()) {
+            default_precision = precision;
+        } else {
+            time_precisions.emplace_back(log_name, precision);
+        }
+    }
+
+    // 获取日志的时间戳精度
+    [[nodiscard]] TimePrecision precision_for(StringView log_name) const noexcept {
+        for (const auto& entry : time_precisions) {
+            if (entry.first == log_name) {
+                return entry.second;
+            }
+        }
+        return default_precision;
+    }
+
+    // 设置队列溢出策略
+    void set_overflow_policy(OverflowPolicy policy) {
+        overflow_policy.store(policy, std::memory_order_relaxed);
+    }
+
+    // 因队列溢出而丢弃的记录数
+    [[nodiscard]] uint64_t dropped_count() const noexcept {
+        return dropped_records.load(std::memory_order_relaxed);
+    }
+
+    // 添加限流规则，log_name 为空匹配所有日志，level 为 0 匹配所有级别（需在写入日志前调用）。
+    // 同时匹配多条规则时，指定了日志名的优先于只指定级别的
+    void set_rate_limit(StringView log_name, int level, RateLimit limit) {
+        rate_rules.push_back({std::string(log_name), level, limit});
+    }
+
+    // 启用重复消息抑制（需在写入日志前调用）
+    void set_dedup(bool enabled) {
+        dedup_enabled = enabled;
+    }
+
+    // 因限流或重复而抑制的记录数
+    [[nodiscard]] uint64_t suppressed_count() const noexcept {
+        return suppressed_records.load(std::memory_order_relaxed);
+    }
+
+    // 定期把运行统计写入 logmonitor.stats 日志（秒，0 表示关闭）
+    void set_stats_interval(unsigned seconds) {
+        stats_interval.store(seconds, std::memory_order_relaxed);
+        request_flush();
+    }
+
+    // 运行统计快照：json 为 false 时每行一项 "名称 值"。
+    // 结果不超过 max_size，放不下的日志条目省略并以 logs_omitted 计数
+    std::string stats(bool json, size_t max_size = std::numeric_limits<size_t>::max()) {
+        std::vector<LogState*> urgent;
+        std::string text;
+        {
+            MutexHold lock(*this);
+            urgent = drain_ring();
+            text = format_stats(json, max_size);
+        }
+        flush_logs(urgent);
+        return text;
+    }
+
+    // 把日志名驻留为 id，之后用 id 写入可免去每条记录的名称查找。
+    // 日志数达到 MAX_LOGS 时返回 INVALID_LOG，用它写入的记录计入 records_rejected
+    LogId log_id(StringView log_name) {
+        RegistryShard& shard = registry[NameHash{}(log_name) % REGISTRY_SHARDS];
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.ids.find(log_name);
+            if (it != shard.ids.end()) {
+                return it->second;
+            }
+        }
+        return create_log(shard, log_name);
+    }
+
+    // 查找已驻留的日志名，不存在时返回 INVALID_LOG
+    [[nodiscard]] LogId find_log_id(StringView log_name) {
+        RegistryShard& shard = registry[NameHash{}(log_name) % REGISTRY_SHARDS];
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.ids.find(log_name);
+        return it != shard.ids.end() ? it->second : INVALID_LOG;
+    }
+
+    // 设置保留的历史日志代数
+    void set_log_generations(unsigned count) {
+        rotation.set_generations(count);
+    }
+
+    // 设置日志目录总大小上限（0 表示不限制）
+    void set_dir_budget(size_t bytes) {
+        rotation.set_dir_budget(bytes);
+    }
+
+    // 设置低功耗模式：空闲刷新时间加倍，批量阈值放大 4 倍，缓冲区满时不再立即刷新
+    void set_low_power_mode(bool enabled) {
+        low_power_mode.store(enabled, std::memory_order_relaxed);
+        request_flush();
+    }
+
+    // 跟随设备电源状态切换低功耗模式：未充电且屏幕熄灭时进入。
+    // 状态只在刷新线程本来就醒着时读取，最多每 30 秒一次
+    void set_follow_power(bool enabled) {
+        follow_power.store(enabled, std::memory_order_relaxed);
+        request_flush();
+    }
+
+    // 写入日志 - 仅入队，格式化和文件写入由刷新线程完成
+    void write_log(StringView log_name, LogLevel level, StringView message, StringView tag = {}) {
+        if (!accepts(level)) {
+            return;
+        }
+        write_log(log_id(log_name), level, message, tag);
+    }
+
+    void write_log(LogId id, LogLevel level, StringView message, StringView tag = {}) {
+        if (!accepts(level)) {
+            return;
+        }
+        LogState* log = find_log(id);
+        if (!log) {
+            rejected_records.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto now = std::chrono::system_clock::now();
+        if (log->mapped && write_mapped(*log->mapped, log->buffer.precision, now, level, tag, message)) {
+            return;
+        }
+        enqueue(now, id, level, tag, message);
+    }
+
+    // 延迟格式化写入 - 格式串在编译期检查，生产者只拷贝格式串和参数，文本由刷新线程生成；
+    // 二进制日志直接保存参数，读取时才格式化。参数限于算术类型、字符串和 const void*
+    //   logger.write_format("gpu-scheduler", LOG_DEBUG, "cpu{} freq={}MHz load={:.1f}%", cpu, freq, load);
+    template <typename... Args>
+    void write_format(StringView log_name, LogLevel level, std::format_string<Args...> format, Args&&... args) {
+        if (!accepts(level)) {
+            return;
+        }
+        write_format(log_id(log_name), level, format, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void write_format(LogId id, LogLevel level, std::format_string<Args...> format, Args&&... args) {
+        if (!accepts(level)) {
+            return;
+        }
+        LogState* log = find_log(id);
+        if (!log) {
+            rejected_records.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        thread_local std::string payload;
+        payload.clear();
+        deferred::encode(payload, format.get(), args...);
+
+        auto now = std::chrono::system_clock::now();
+        if (log->mapped) {
+            // 映射区由生产者直接写入，只能在这里生成文本
+            thread_local std::string text;
+            text.clear();
+            deferred::render(text, payload);
+            if (write_mapped(*log->mapped, log->buffer.precision, now, level, {}, text)) {
+                return;
+            }
+        }
+        enqueue(now, id, level, {}, payload, true);
+    }
+
+    // 启用崩溃恢复日志（守护进程启动时调用），并补写上次异常退出时未落盘的记录。
+    // 补写的记录保留原时间戳，标签加上 "recovered"
+    bool enable_journal(size_t capacity) {
+        auto candidate = std::make_unique<RecordJournal>(log_dir + "/" + JOURNAL_FILE, capacity);
+        if (!candidate->open_journal()) {
+            return false;
+        }
+
+        MutexHold lock(*this);
+        std::map<LogState*, size_t> counts;
+        std::string tag;
+        size_t count = candidate->recover([&](const RecordJournal::Recovered& record) {
+            LogState* log = find_log(log_id(record.name));
+            if (!log) {
+                return;
+            }
+            tag.assign(record.tag);
+            tag += tag.empty() ? "recovered" : ",recovered";
+            std::lock_guard<std::mutex> buffer_lock(log->buffer_mutex);
+            append_to_buffer(log->buffer, record.timestamp, record.level, tag, record.message, record.deferred);
+            ++counts[log];
+        });
+        if (count > 0) {
+            auto now = std::chrono::system_clock::now();
+            for (const auto& entry : counts) {
+                {
+                    std::lock_guard<std::mutex> buffer_lock(entry.first->buffer_mutex);
+                    append_to_buffer(entry.first->buffer, now, LOG_WARN, {},
+                                     "Recovered " + std::to_string(entry.second) +
+                                     " records that were not flushed before the previous daemon exit");
+                    entry.first->buffer.has_error = true;  // 补写的内容落盘后才清空恢复日志
+                }
+                flush_log(*entry.first, true);
+            }
+            recovered_records += count;
+        }
+        candidate->reset();
+        std::lock_guard<std::mutex> journal_lock(journal_mutex);
+        journal = std::move(candidate);
+        journal_enabled.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // 刷新指定日志缓冲区
+    void flush_buffer(const std::string& log_name) {
+        std::vector<LogState*> urgent;
+        {
+            MutexHold lock(*this);
+            urgent = drain_ring();
+        }
+        flush_logs(urgent);
+        if (LogState* log = find_log(find_log_id(log_name))) {
+            flush_log(*log, true);
+        }
+    }
+
+    // 刷新所有日志缓冲区
+    void flush_all() {
+        {
+            MutexHold lock(*this);
+            drain_ring();
+        }
+        for_each_log([this](LogState& log) {
+            flush_log(log, true);
+        });
+    }
+
+    // 清理所有日志
+    void clean_logs() {
+        MutexHold lock(*this);
+
+        // 丢弃队列中尚未写入的记录
+        std::vector<uint32_t> discarded;
+        while (ring.pop([&](const RecordRing::Record& record) {
+            if (record.journal_offset != RecordRing::NO_JOURNAL) {
+                discarded.push_back(record.journal_offset);
+            }
+        })) {}
+        release_journal(discarded);
+
+        // 删除期间持有所有日志的 file_mutex，其他线程的刷新等到删除完成后写入新文件
+        std::vector<std::unique_lock<std::mutex>> file_locks;
+        for_each_log([&](LogState& log) {
+            file_locks.emplace_back(log.file_mutex);
+            finish_batch(log, true);
+            log.file.close_fd();
+            std::lock_guard<std::mutex> buffer_lock(log.buffer_mutex);
+            release_journal(log.buffer.journal_entries);
+            log.buffer.clear();
+            log.buffer.filter.summarize([](LogLevel, const std::string&) {});
+        });
+        for (auto& segment_pair : mapped_logs) {
+            segment_pair.second->close_segment();
+        }
+
+        // 删除完成后重新创建内存映射段
+        struct SegmentReopener {
+            decltype(mapped_logs)& segments;
+            ~SegmentReopener() {
+                for (auto& segment_pair : segments) {
+                    segment_pair.second->open_segment();
+                }
+            }
+        } reopener{mapped_logs};
+
+        // 删除日志文件
+        DIR *dir = opendir(log_dir.c_str());
+        if (!dir) {
+            std::cerr << "Cannot open log directory for cleaning: " << log_dir << " (" << strerror(errno) << ")" << std::endl;
+            std::string cmd = "rm -f \"" + log_dir + "\"/*.log \"" + log_dir + "\"/*.log.* \"" +
+                              log_dir + "\"/*.blog \"" + log_dir + "\"/*.blog.*";
+            system(cmd.c_str());
+            return;
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string filename = entry->d_name;
+            if (filename == "." || filename == "..") {
+                continue;
+            }
+
+            // 检查是否为日志文件、其历史代或索引
+            if (is_log_file_name(filename) || is_index_file_name(filename)) {
+                std::string full_path = log_dir + "/" + filename;
+                if (remove(full_path.c_str()) != 0) {
+                    std::cerr << "Cannot delete log file: " << full_path << " (" << strerror(errno) << ")" << std::endl;
+                }
+            }
+        }
+        closedir(dir);
+    }
+
+    // 主循环检查的辅助函数
+    [[nodiscard]] bool is_running() const noexcept {
+        return running.load(std::memory_order_relaxed);
+    }
+
+private:
+    // 创建日志目录
+    void create_log_directory() {
+        struct stat st;
+        // 检查目录是否存在
+        if (stat(log_dir.c_str(), &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                // 目录存在，检查权限
+                if (access(log_dir.c_str(), W_OK | X_OK) != 0) {
+                    std::cerr << "Warning: Insufficient permissions for log directory: " << log_dir << " (" << strerror(errno) << ")" << std::endl;
+                    chmod(log_dir.c_str(), 0755);
+                }
+                return;
+            } else {
+                std::cerr << "Error: Log path exists but is not a directory: " << log_dir << std::endl;
+                log_dir = "./logs";
+                std::cerr << "Trying alternative log directory: " << log_dir << std::endl;
+                if (stat(log_dir.c_str(), &st) != 0) {
+                    // 替代目录也不存在
+                } else if (!S_ISDIR(st.st_mode)) {
+                    std::cerr << "Error: Alternative log path also exists but is not a directory: " << log_dir << std::endl;
+                    throw std::runtime_error("Cannot initialize log directory");
+                } else {
+                    // 替代目录存在且是目录
+                    return;
+                }
+            }
+        }
+
+        // 尝试创建目录
+        std::string cmd = "mkdir -p \"" + log_dir + "\"";
+        int ret = system(cmd.c_str());
+        if (ret != 0) {
+            std::cerr << "Cannot create log directory (using system): " << log_dir << std::endl;
+            if (stat(log_dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                std::cerr << "Error: Failed to create log directory, please check permissions or path." << std::endl;
+                throw std::runtime_error("Cannot create log directory");
+            }
+        }
+        
+        if (chmod(log_dir.c_str(), 0755) != 0) {
+            std::cerr << "Warning: Cannot set log directory permissions: " << log_dir << " (" << strerror(errno) << ")" << std::endl;
+        }
+    }
+
+    // 查找内存映射日志段
+    [[nodiscard]] MappedSegment* find_mapped_log(StringView log_name) {
+        if (mapped_logs.empty()) {
+            return nullptr;
+        }
+        auto it = mapped_logs.find(log_name);
+        return it != mapped_logs.end() ? it->second.get() : nullptr;
+    }
+
+    // 直接格式化到映射区，不经过队列和缓冲区
+    bool write_mapped(MappedSegment& segment, TimePrecision precision, std::chrono::system_clock::time_point timestamp,
+                      LogLevel level, StringView tag, StringView message) {
+        const char* time_str = format_time(timestamp, precision);
+        const char* level_str = get_level_string(level);
+        size_t time_len = strlen(time_str);
+        size_t level_len = strlen(level_str);
+        size_t entry_size = text_record_size(time_str, level, tag, message);
+
+        bool written = segment.append(entry_size, [&](char* dst) {
+            auto put = [&dst](const void* src, size_t len) {
+                std::memcpy(dst, src, len);
+                dst += len;
+            };
+            put(time_str, time_len);
+            put(" [", 2);
+            put(level_str, level_len);
+            put("] ", 2);
+            if (!tag.empty()) {
+                put("[", 1);
+                put(tag.data(), tag.size());
+                put("] ", 2);
+            }
+            put(message.data(), message.size());
+            *dst = '\n';
+        });
+
+        // ERROR 需要尽快落盘
+        if (written && level == LOG_ERROR) {
+            segment.request_sync();
+            request_flush();
+        }
+        return written;
+    }
+
+    // 唤醒刷新线程
+    void request_flush() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            flush_requested = true;
+        }
+        wake_cv.notify_one();
+    }
+
+    // 级别被过滤或日志系统已停止时返回 false
+    bool accepts(LogLevel level) noexcept {
+        if (static_cast<int>(level) > log_level.load(std::memory_order_relaxed)) {
+            level_filtered.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return running.load(std::memory_order_relaxed);
+    }
+
+    // 按 id 取日志状态，id 无效时返回 nullptr
+    [[nodiscard]] LogState* find_log(LogId id) const noexcept {
+        if (id >= log_count.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return log_table[id].get();
+    }
+
+    // 新建日志状态并按配置初始化，发布后其他线程才能通过 id 访问
+    LogId create_log(RegistryShard& shard, StringView log_name) {
+        std::lock_guard<std::mutex> create_lock(create_mutex);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.ids.find(log_name);
+        if (it != shard.ids.end()) {
+            return it->second;
+        }
+        LogId id = log_count.load(std::memory_order_relaxed);
+        if (id >= MAX_LOGS) {
+            return INVALID_LOG;
+        }
+
+        auto log = std::make_unique<LogState>();
+        log->name.assign(log_name);
+        log->mapped = find_mapped_log(log_name);
+        LogBuffer& buffer = log->buffer;
+        buffer.binary = std::find(binary_logs.begin(), binary_logs.end(), log_name) != binary_logs.end();
+        buffer.precision = precision_for(log_name);
+
+        // 每个级别取最具体的限流规则
+        std::array<RateLimit, 4> limits{};
+        std::array<int, 4> best{-1, -1, -1, -1};
+        for (const auto& rule : rate_rules) {
+            if (!rule.log_name.empty() && rule.log_name != log_name) {
+                continue;
+            }
+            int score = (rule.log_name.empty() ? 0 : 2) + (rule.level == 0 ? 0 : 1);
+            for (int level = LOG_ERROR; level <= LOG_DEBUG; ++level) {
+                if ((rule.level == 0 || rule.level == level) && score >= best[level - 1]) {
+                    best[level - 1] = score;
+                    limits[level - 1] = rule.limit;
+                }
+            }
+        }
+        buffer.filter.configure(limits, dedup_enabled);
+
+        log_table[id] = std::move(log);
+        shard.ids.emplace(std::string(log_name), id);
+        log_count.store(id + 1, std::memory_order_release);
+        return id;
+    }
+
+    // 依次处理每个已驻留的日志
+    template <typename Function>
+    void for_each_log(Function&& function) {
+        uint32_t count = log_count.load(std::memory_order_acquire);
+        for (uint32_t id = 0; id < count; ++id) {
+            function(*log_table[id]);
+        }
+    }
+
+    // 记录入队 - 生产者热路径，不持有 log_mutex
+    void enqueue(std::chrono::system_clock::time_point timestamp, LogId id, LogLevel level,
+                 StringView tag, StringView message, bool is_deferred = false) {
+        auto policy = static_cast<OverflowPolicy>(overflow_policy.load(std::memory_order_relaxed));
+
+        // 队列接近满时优先丢弃 DEBUG 记录
+        if (policy == OVERFLOW_DROP_DEBUG && level == LOG_DEBUG && ring.size() >= RecordRing::CAPACITY * 3 / 4) {
+            dropped_records.fetch_add(1, std::memory_order_relaxed);
+            request_flush();
+            return;
+        }
+
+        while (!push_record(timestamp, id, level, tag, message, is_deferred)) {
+            request_flush();
+            if (policy == OVERFLOW_DROP_OLDEST) {
+                std::vector<uint32_t> discarded;
+                if (ring.pop([&](const RecordRing::Record& record) {
+                    if (record.journal_offset != RecordRing::NO_JOURNAL) {
+                        discarded.push_back(record.journal_offset);
+                    }
+                })) {
+                    dropped_records.fetch_add(1, std::memory_order_relaxed);
+                    release_journal(discarded);
+                }
+            } else {
+                if (!running.load(std::memory_order_relaxed)) {
+                    dropped_records.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        // 仅在需要时唤醒刷新线程：ERROR 立即落盘，队列过半时及时排空，
+        // 刷新线程没有待刷新的缓冲区时由第一条记录唤醒（与 flush_thread_func 中的检查配对）
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (level == LOG_ERROR || (ring.size() >= RecordRing::CAPACITY / 2 &&
+                                   !half_full_signaled.load(std::memory_order_relaxed) &&
+                                   !half_full_signaled.exchange(true)) ||
+            (wake_on_record.load(std::memory_order_relaxed) && wake_on_record.exchange(false))) {
+            request_flush();
+        }
+    }
+
+    // 将队列中的记录格式化到各日志缓冲区（调用方需持有 log_mutex），
+    // 返回需要立即刷新的日志，由调用方释放 log_mutex 后用 flush_logs 写出。
+    // bounded 时一旦有日志需要刷新且已取出一个队列容量的记录就返回，持续写入时也能及时写出
+    std::vector<LogState*> drain_ring(bool bounded = false) {
+        bool is_low_power = low_power_mode.load(std::memory_order_relaxed);
+        size_t current_max_size = batch_size;
+        auto now = Clock::now();
+
+        std::vector<LogState*> urgent;
+
+        // 连续的同一日志的记录只加一次锁
+        LogState* held = nullptr;
+        std::unique_lock<std::mutex> buffer_lock;
+        std::vector<uint32_t> unused_journal;  // 被抑制或无处写入的记录，不再需要恢复
+
+        auto append_record = [&](std::chrono::system_clock::time_point timestamp, LogLevel level,
+                                 LogState* log, StringView tag, StringView message, bool is_deferred,
+                                 uint32_t journal_offset) {
+            if (!log) {
+                if (journal_offset != RecordRing::NO_JOURNAL) {
+                    unused_journal.push_back(journal_offset);
+                }
+                return;
+            }
+            if (log != held) {
+                if (buffer_lock.owns_lock()) {
+                    buffer_lock.unlock();
+                }
+                buffer_lock = std::unique_lock<std::mutex>(log->buffer_mutex);
+                held = log;
+            }
+
+            LogBuffer& buffer = log->buffer;
+            auto emit_summary = [&](LogLevel summary_level, const std::string& text) {
+                if (journal) {
+                    journal_summary(*log, timestamp, summary_level, text);
+                }
+                append_to_buffer(buffer, timestamp, summary_level, {}, text);
+            };
+            if (!buffer.filter.admit(timestamp, level, tag, message, is_deferred, emit_summary)) {
+                suppressed_records.fetch_add(1, std::memory_order_relaxed);
+                ++buffer.suppressed;
+                if (journal_offset != RecordRing::NO_JOURNAL) {
+                    unused_journal.push_back(journal_offset);
+                }
+                return;
+            }
+            if (journal_offset != RecordRing::NO_JOURNAL) {
+                buffer.journal_entries.push_back(journal_offset);
+            }
+            append_to_buffer(buffer, timestamp, level, tag, message, is_deferred);
+            buffer.last_write = now;
+            if (level == LOG_ERROR) {
+                buffer.has_error = true;
+            }
+
+            if ((level == LOG_ERROR) || (!is_low_power && buffer.size >= current_max_size)) {
+                if (std::find(urgent.begin(), urgent.end(), log) == urgent.end()) {
+                    urgent.push_back(log);
+                }
+            }
+        };
+
+        size_t popped = 0;
+        while ((!bounded || urgent.empty() || popped < RecordRing::CAPACITY) &&
+               ring.pop([&](const RecordRing::Record& record) {
+            append_record(record.timestamp, record.level, find_log(record.log_id), record.tag, record.message,
+                          record.deferred, record.journal_offset);
+        })) {
+            ++popped;
+        }
+
+        // 报告溢出丢弃的记录
+        uint64_t dropped = dropped_records.load(std::memory_order_relaxed);
+        if (dropped != reported_drops) {
+            std::string note = "Dropped " + std::to_string(dropped - reported_drops) + " log records (queue overflow)";
+            reported_drops = dropped;
+            append_record(std::chrono::system_clock::now(), LOG_WARN, find_log(log_id("system")), {}, note, false,
+                          RecordRing::NO_JOURNAL);
+        }
+        uint64_t rejected = rejected_records.load(std::memory_order_relaxed);
+        if (rejected != reported_rejects) {
+            std::string note = "Rejected " + std::to_string(rejected - reported_rejects) +
+                               " log records for new log names (limit of " + std::to_string(MAX_LOGS) + " logs reached)";
+            reported_rejects = rejected;
+            // system 日志本身也可能因数量上限无法创建
+            if (LogState* system_log = find_log(log_id("system"))) {
+                append_record(std::chrono::system_clock::now(), LOG_WARN, system_log, {}, note, false,
+                              RecordRing::NO_JOURNAL);
+            } else {
+                std::cerr << note << std::endl;
+            }
+        }
+        if (buffer_lock.owns_lock()) {
+            buffer_lock.unlock();
+        }
+        release_journal(unused_journal);
+        half_full_signaled.store(false, std::memory_order_relaxed);
+        return urgent;
+    }
+
+    // 在调用线程上依次写出日志（调用方不能持有这些日志的锁）。不同线程可同时刷新不同的日志，
+    // 启用异步写入时各日志的写入在内核中重叠进行
+    void flush_logs(const std::vector<LogState*>& logs) {
+        for (LogState* log : logs) {
+            flush_log(*log);
+        }
+    }
+
+    // 格式化运行统计（调用方需持有 log_mutex）
+    std::string format_stats(bool json, size_t max_size = std::numeric_limits<size_t>::max()) {
+        // 正在写入的日志不等待，按已打开计
+        size_t open_files = 0;
+        for_each_log([&](LogState& log) {
+            std::unique_lock<std::mutex> file_lock(log.file_mutex, std::try_to_lock);
+            if (!file_lock.owns_lock() || log.file.fd >= 0) {
+                ++open_files;
+            }
+        });
+        size_t open_fds = 0;
+        if (DIR* fd_dir = opendir("/proc/self/fd")) {
+            while (readdir(fd_dir)) {
+                ++open_fds;
+            }
+            closedir(fd_dir);
+            open_fds = open_fds > 3 ? open_fds - 3 : 0;  // ".", ".." 和 opendir 自身
+        }
+
+        const std::pair<const char*, uint64_t> totals[] = {
+            {"uptime_s", static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - started_at).count())},
+            {"records_dropped", dropped_records.load(std::memory_order_relaxed)},
+            {"records_rejected", rejected_records.load(std::memory_order_relaxed)},
+            {"records_level_filtered", level_filtered.load(std::memory_order_relaxed)},
+            {"records_suppressed", suppressed_records.load(std::memory_order_relaxed)},
+            {"flushes", flush_count.load(std::memory_order_relaxed)},
+            {"bytes_written", bytes_written.load(std::memory_order_relaxed)},
+            {"rotations", rotation.rotation_count()},
+            {"records_recovered", recovered_records},
+            {"journal_bytes", journal_bytes()},
+            {"queue_depth", ring.size()},
+            {"open_log_files", open_files + mapped_logs.size()},
+            {"open_fds", open_fds},
+            {"buffer_max_size", buffer_max_size.load(std::memory_order_relaxed)},
+            {"batch_size", batch_size},
+            {"write_rate_bps", static_cast<uint64_t>(write_rate)},
+            {"max_idle_time_ms", max_idle_time.load(std::memory_order_relaxed)},
+            {"low_power", low_power_mode.load(std::memory_order_relaxed) ? 1u : 0u},
+            {"async_io", async_io.load(std::memory_order_relaxed) ? 1u : 0u},
+            {"flush_wakeups", wakeups},
+            {"logs", log_count.load(std::memory_order_relaxed)},
+            {"log_size_limit", log_size_limit.load(std::memory_order_relaxed)},
+        };
+
+        // 为结尾和 logs_omitted 计数预留的空间
+        constexpr size_t TRAILER_SIZE = 48;
+        size_t omitted = 0;
+        std::string entry;
+        auto append_entry = [&](std::string& out) {
+            if (out.size() + entry.size() + TRAILER_SIZE > max_size) {
+                ++omitted;
+            } else {
+                out += entry;
+            }
+        };
+
+        std::string out;
+        if (!json) {
+            for (const auto& total : totals) {
+                out += total.first;
+                out += ' ' + std::to_string(total.second) + '\n';
+            }
+            {
+                std::lock_guard<std::mutex> latency_lock(latency_mutex);
+                flush_latency.append_text(out, "flush_latency_us");
+            }
+            mutex_hold.append_text(out, "mutex_hold_us");
+            for_each_log([&](LogState& log) {
+                std::lock_guard<std::mutex> buffer_lock(log.buffer_mutex);
+                const LogBuffer& buffer = log.buffer;
+                entry = "log " + log.name + " records=" + std::to_string(buffer.records) +
+                        " bytes=" + std::to_string(buffer.bytes) + " suppressed=" + std::to_string(buffer.suppressed) +
+                        " flushes=" + std::to_string(buffer.flushes) + " buffered=" + std::to_string(buffer.size) +
+                        " high_water=" + std::to_string(buffer.high_water) + '\n';
+                append_entry(out);
+            });
+            if (omitted > 0) {
+                out += "logs_omitted " + std::to_string(omitted) + '\n';
+            }
+            return out;
+        }
+
+        out += '{';
+        for (const auto& total : totals) {
+            append_json_string(out, total.first);
+            out += ':' + std::to_string(total.second) + ',';
+        }
+        out += "\"flush_latency_us\":";
+        {
+            std::lock_guard<std::mutex> latency_lock(latency_mutex);
+            flush_latency.append_json(out);
+        }
+        out += ",\"mutex_hold_us\":";
+        mutex_hold.append_json(out);
+        out += ",\"logs\":{";
+        bool first = true;
+        for_each_log([&](LogState& log) {
+            std::lock_guard<std::mutex> buffer_lock(log.buffer_mutex);
+            const LogBuffer& buffer = log.buffer;
+            entry.assign(first ? "" : ",");
+            append_json_string(entry, log.name);
+            entry += ":{\"records\":" + std::to_string(buffer.records) + ",\"bytes\":" + std::to_string(buffer.bytes) +
+                     ",\"suppressed\":" + std::to_string(buffer.suppressed) + ",\"flushes\":" + std::to_string(buffer.flushes) +
+                     ",\"buffered\":" + std::to_string(buffer.size) + ",\"high_water\":" + std::to_string(buffer.high_water) + '}';
+            size_t before = omitted;
+            append_entry(out);
+            first = first && omitted != before;
+        });
+        out += '}';
+        if (omitted > 0) {
+            out += ",\"logs_omitted\":" + std::to_string(omitted);
+        }
+        out += "}\n";
+        return out;
+    }
+
+    // 把运行统计逐行写入 logmonitor.stats 日志（调用方需持有 log_mutex），返回该日志供调用方刷新
+    LogState* dump_stats() {
+        std::string text = format_stats(false);
+        LogState* log = find_log(log_id("logmonitor.stats"));
+        if (!log) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> buffer_lock(log->buffer_mutex);
+        auto timestamp = std::chrono::system_clock::now();
+        StringView lines(text);
+        while (!lines.empty()) {
+            size_t end = std::min(lines.find('\n'), lines.size());
+            append_to_buffer(log->buffer, timestamp, LOG_INFO, {}, lines.substr(0, end));
+            lines.remove_prefix(std::min(end + 1, lines.size()));
+        }
+        return log;
+    }
+
+    // 格式化一条记录到缓冲区（调用方需持有 buffer_mutex），延迟格式化的内容在文本日志中于此生成
+    void append_to_buffer(LogBuffer& buffer, std::chrono::system_clock::time_point timestamp, LogLevel level,
+                          StringView tag, StringView message, bool is_deferred = false) {
+        size_t size_before = buffer.size;
+        if (buffer.binary) {
+            // 二进制格式：不做文本格式化
+            int64_t timestamp_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                timestamp.time_since_epoch()).count();
+            std::string& chunk = buffer.tail(message.size() + tag.size() + 32);
+            buffer.size += buffer.encoder.encode(chunk, timestamp_ms, level, tag, message, is_deferred);
+        } else {
+            if (is_deferred) {
+                thread_local std::string rendered;
+                rendered.clear();
+                deferred::render(rendered, message);
+                message = rendered;
+            }
+            const char* time_str = format_time(timestamp, buffer.precision);
+            size_t entry_size = text_record_size(time_str, level, tag, message);
+            append_text_record(buffer.tail(entry_size), time_str, level, tag, message);
+            buffer.index.add(buffer.size, entry_size, level,
+                             std::chrono::duration_cast<std::chrono::milliseconds>(timestamp.time_since_epoch()).count());
+            buffer.size += entry_size;
+        }
+        buffer.records++;
+        buffer.bytes += buffer.size - size_before;
+        appended_bytes.fetch_add(buffer.size - size_before, std::memory_order_relaxed);
+        buffer.high_water = std::max(buffer.high_water, buffer.size);
+    }
+
+    // 把日志缓冲区交换出的批次写入文件。持有 file_mutex 写入，缓冲区在写入期间可继续接收记录；
+    // 异步写入时上一批次完成后才交换下一批次，wait 为 true 时等本批次写完再返回。
+    // 调用方不能持有该日志的 buffer_mutex
+    void flush_log(LogState& log, bool wait = false) {
+        std::lock_guard<std::mutex> file_lock(log.file_mutex);
+        finish_batch(log, true);
+        Batch& batch = log.batch;
+        bool binary;
+        {
+            std::lock_guard<std::mutex> buffer_lock(log.buffer_mutex);
+            LogBuffer& buffer = log.buffer;
+
+            // 本窗口内被抑制的记录以摘要形式写在最后
+            auto timestamp = std::chrono::system_clock::now();
+            buffer.filter.summarize([&](LogLevel level, const std::string& text) {
+                append_to_buffer(buffer, timestamp, level, {}, text);
+            });
+            if (buffer.size == 0) {
+                return;
+            }
+            buffer.take(batch);
+            ++buffer.flushes;
+            binary = buffer.binary;
+        }
+
+        // 内存映射日志中进入缓冲区的记录（超过段大小、段暂时不可用、摘要、恢复的记录）也写入映射段：
+        // 以 O_APPEND 写入同一文件会落在预分配的填充之后，关闭段时被截掉
+        if (log.mapped && !binary) {
+            log.file.close_fd();
+            size_t written = 0;
+            for (const auto& chunk : batch.chunks) {
+                if (log.mapped->append_lines(chunk)) {
+                    written += chunk.size();
+                } else {
+                    std::cerr << "Failed to write to log segment: " << log.name << std::endl;
+                }
+            }
+            bytes_written.fetch_add(written, std::memory_order_relaxed);
+            flush_count.fetch_add(1, std::memory_order_relaxed);
+            if (batch.has_error) {
+                log.mapped->request_sync();
+            }
+            release_batch(batch);
+            return;
+        }
+
+        // 构建日志文件路径
+        std::string log_path = log_dir + "/";
+        log_path += log.name;
+        log_path += binary ? binlog::FILE_SUFFIX : ".log";
+
+        if (write_batch(log.file, log_path, batch, binary)) {
+            if (wait) {
+                finish_batch(log, true);
+            }
+            return;
+        }
+        release_batch(batch);
+    }
+
+    // 批次已写出或丢弃：释放恢复日志记录，只保留首个数据块的内存
+    void release_batch(Batch& batch) {
+        release_journal(batch.journal_entries);
+        batch.chunks.resize(1);
+        batch.chunks.front().clear();
+        batch.index.reset();
+    }
+
+    // 写出批次（调用方需持有 file_mutex），按需轮换和打开文件。
+    // 已异步提交时返回 true，批次由 finish_batch 收尾
+    bool write_batch(LogFile& log_file, const std::string& log_path, Batch& batch, bool binary) {
+        // 检查文件大小并处理轮换
+        size_t current_log_size_limit = log_size_limit.load(std::memory_order_relaxed);
+        if (log_file.fd >= 0 && log_file.current_size > current_log_size_limit) {
+            log_file.close_fd();
+
+            // 轮换日志文件，压缩由后台线程完成
+            rotation.rotate(log_path);
+
+            log_file.current_size = 0;
+        }
+
+        // 确保文件已打开，文件大小只在打开时获取一次
+        if (log_file.fd < 0) {
+            log_file.fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (log_file.fd < 0) {
+                std::cerr << "Cannot open log file for writing: " << log_path << " (" << strerror(errno) << ")" << std::endl;
+                return false;
+            }
+
+            struct stat st;
+            if (fstat(log_file.fd, &st) != 0) {
+                log_file.current_size = 0;
+                std::cerr << "Warning: Cannot get log file size: " << log_path << std::endl;
+            } else {
+                log_file.current_size = static_cast<size_t>(st.st_size);
+            }
+        }
+
+        // 新建的二进制日志文件先写入文件头
+        if (binary && log_file.current_size == 0) {
+            batch.chunks.front().insert(0, binlog::MAGIC, binlog::MAGIC_SIZE);
+            batch.size += binlog::MAGIC_SIZE;
+        }
+
+        if (async_io.load(std::memory_order_acquire) && submit_batch(log_file, log_path, batch)) {
+            return true;
+        }
+
+        // 一次 writev 写入所有数据块
+        auto flush_start = Clock::now();
+        if (!write_chunks(log_file.fd, batch.chunks)) {
+            std::cerr << "Failed to write to log file: " << log_path << " (" << strerror(errno) << ")" << std::endl;
+            log_file.close_fd();
+            log_file.current_size = 0;
+        } else {
+            // 仅在包含 ERROR 时确保数据落盘
+            if (batch.has_error) {
+                fdatasync(log_file.fd);
+            }
+            if (!binary) {
+                write_index(log_file, log_path, batch.index, log_file.current_size);
+            }
+            log_file.current_size += batch.size;
+            log_file.last_access = Clock::now();
+            bytes_written.fetch_add(batch.size, std::memory_order_relaxed);
+        }
+        {
+            std::lock_guard<std::mutex> latency_lock(latency_mutex);
+            flush_latency.record(Clock::now() - flush_start);
+        }
+        flush_count.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // 提交批次的异步写入（调用方需持有 file_mutex），队列已满或提交失败时返回 false，由调用方同步写出。
+    // 文件大小提交时即计入，后续的轮换判断不必等待完成
+    bool submit_batch(LogFile& log_file, const std::string& log_path, Batch& batch) {
+        batch.iov.clear();
+        for (const auto& chunk : batch.chunks) {
+            if (!chunk.empty()) {
+                batch.iov.push_back({const_cast<char*>(chunk.data()), chunk.size()});
+            }
+        }
+        if (batch.iov.size() > IOV_MAX) {
+            return false;
+        }
+        batch.write_request.pending = &batch.pending;
+        batch.sync_request.pending = &batch.pending;
+        if (!uring.submit_write(log_file.fd, batch.iov.data(), static_cast<unsigned>(batch.iov.size()),
+                                batch.write_request, batch.has_error ? &batch.sync_request : nullptr)) {
+            return false;
+        }
+        batch.in_flight = true;
+        batch.offset = log_file.current_size;
+        batch.path = log_path;
+        batch.submitted = Clock::now();
+        log_file.current_size += batch.size;
+        log_file.last_access = batch.submitted;
+        flush_count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 收尾异步提交的批次（调用方需持有 file_mutex）：检查结果，补写不完整的部分，写出索引并释放批次。
+    // wait 为 false 且尚未完成时返回 false
+    bool finish_batch(LogState& log, bool wait) {
+        Batch& batch = log.batch;
+        if (!batch.in_flight) {
+            return true;
+        }
+        UringQueue::Completion state = uring.complete(batch.pending, wait);
+        if (state == UringQueue::COMPLETION_PENDING) {
+            return false;
+        }
+        batch.in_flight = false;
+
+        LogFile& log_file = log.file;
+        int written = batch.write_request.result;
+        bool ok = written >= 0;
+        if (state == UringQueue::COMPLETION_FAILED) {
+            // 无法确认写入结果，丢弃这一批次，之后同步写入
+            async_io.store(false, std::memory_order_release);
+            ok = false;
+            errno = EIO;
+        } else if (ok && static_cast<size_t>(written) < batch.size) {
+            // 写入不完整，链接的同步已被取消，剩余部分同步写出
+            ok = write_chunks(log_file.fd, batch.chunks, static_cast<size_t>(written));
+            if (ok && batch.has_error) {
+                fdatasync(log_file.fd);
+            }
+        } else if (!ok) {
+            errno = -written;
+        }
+
+        if (!ok) {
+            std::cerr << "Failed to write to log file: " << batch.path << " (" << strerror(errno) << ")" << std::endl;
+            log_file.close_fd();
+            log_file.current_size = 0;
+        } else {
+            write_index(log_file, batch.path, batch.index, batch.offset);
+            bytes_written.fetch_add(batch.size, std::memory_order_relaxed);
+        }
+        {
+            std::lock_guard<std::mutex> latency_lock(latency_mutex);
+            flush_latency.record(Clock::now() - batch.submitted);
+        }
+        release_batch(batch);
+        return true;
+    }
+
+    // 入队，启用崩溃恢复日志时同时写入：两者在 journal_mutex 下完成，恢复时按入队顺序补写，
+    // 记录在队列中等待刷新线程期间进程被杀死也能恢复。这里不做文件 I/O：恢复日志已满时
+    // 这条记录不受保护；用量超过四分之三时由刷新线程写出持有恢复日志记录的缓冲区腾出空间。
+    // 队列已满时返回 false
+    bool push_record(std::chrono::system_clock::time_point timestamp, LogId id, LogLevel level,
+                     StringView tag, StringView message, bool is_deferred) {
+        if (!journal_enabled.load(std::memory_order_acquire)) {
+            return ring.push(timestamp, level, id, tag, message, is_deferred);
+        }
+        LogState* log = find_log(id);
+        bool pressure = false;
+        {
+            std::lock_guard<std::mutex> journal_lock(journal_mutex);
+            uint32_t offset = RecordRing::NO_JOURNAL;
+            if (log && journal->can_hold(log->name.size(), tag.size(), message.size()) &&
+                !journal->append(timestamp, level, log->name, tag, message, is_deferred, offset)) {
+                offset = RecordRing::NO_JOURNAL;
+            }
+            pressure = journal->under_pressure();
+            if (!ring.push(timestamp, level, id, tag, message, is_deferred, offset)) {
+                if (offset != RecordRing::NO_JOURNAL) {
+                    journal->release({offset});
+                }
+                return false;
+            }
+        }
+        if (pressure && !journal_pressure.exchange(true, std::memory_order_relaxed)) {
+            request_flush();
+        }
+        return true;
+    }
+
+    // 刷新线程生成的摘要记录写入崩溃恢复日志（调用方需持有 log_mutex 和该日志的 buffer_mutex），
+    // 空间不足时不记录
+    void journal_summary(LogState& log, std::chrono::system_clock::time_point timestamp, LogLevel level,
+                         StringView text) {
+        std::lock_guard<std::mutex> journal_lock(journal_mutex);
+        uint32_t offset;
+        if (journal->append(timestamp, level, log.name, {}, text, false, offset)) {
+            log.buffer.journal_entries.push_back(offset);
+        }
+    }
+
+    // 批次已写出或丢弃，对应的恢复日志记录不再需要
+    void release_journal(std::vector<uint32_t>& entries) {
+        if (!entries.empty()) {
+            std::lock_guard<std::mutex> journal_lock(journal_mutex);
+            if (journal) {
+                journal->release(entries);
+            }
+        }
+        entries.clear();
+    }
+
+    // 崩溃恢复日志已用字节数
+    [[nodiscard]] uint64_t journal_bytes() {
+        std::lock_guard<std::mutex> journal_lock(journal_mutex);
+        return journal ? journal->used() : 0;
+    }
+
+    // 把批次的索引块换算为文件偏移后追加到侧边索引，base 为批次写入前的文件大小。
+    // 日志从空文件开始写时同时清空索引，避免残留的旧条目
+    void write_index(LogFile& log_file, const std::string& log_path, logindex::Builder& index, size_t base) {
+        index.close_block();
+        if (index.blocks.empty()) {
+            return;
+        }
+        if (log_file.index_fd < 0) {
+            int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (base == 0 ? O_TRUNC : 0);
+            log_file.index_fd = open(logindex::path_for(log_path).c_str(), flags, 0644);
+            if (log_file.index_fd < 0) {
+                return;
+            }
+        }
+        for (auto& entry : index.blocks) {
+            entry.offset += base;
+        }
+        std::string_view data(reinterpret_cast<const char*>(index.blocks.data()), index.blocks.size() * sizeof(logindex::Entry));
+        while (!data.empty()) {
+            ssize_t written = write(log_file.index_fd, data.data(), data.size());
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            data.remove_prefix(static_cast<size_t>(written));
+        }
+    }
+
+    // 使用 writev 写出所有数据块（跳过开头已写入的 skip 字节），处理部分写入
+    static bool write_chunks(int fd, const std::vector<std::string>& chunks, size_t skip = 0) {
+        std::vector<iovec> iov;
+        iov.reserve(chunks.size());
+        for (const auto& chunk : chunks) {
+            if (skip >= chunk.size()) {
+                skip -= chunk.size();
+            } else {
+                iov.push_back({const_cast<char*>(chunk.data()) + skip, chunk.size() - skip});
+                skip = 0;
+            }
+        }
+
+        size_t index = 0;
+        while (index < iov.size()) {
+            int count = static_cast<int>(std::min<size_t>(iov.size() - index, IOV_MAX));
+            ssize_t written = writev(fd, iov.data() + index, count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+
+            // 跳过已完整写入的数据块
+            auto remaining = static_cast<size_t>(written);
+            while (index < iov.size() && remaining >= iov[index].iov_len) {
+                remaining -= iov[index].iov_len;
+                ++index;
+            }
+            if (remaining > 0) {
+                iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + remaining;
+                iov[index].iov_len -= remaining;
+            }
+        }
+        return true;
+    }
+
+    // 低功耗模式下的空闲刷新时间加倍
+    [[nodiscard]] std::chrono::milliseconds idle_limit() const noexcept {
+        unsigned int ms = max_idle_time.load(std::memory_order_relaxed);
+        return std::chrono::milliseconds(low_power_mode.load(std::memory_order_relaxed) ? ms * 2ULL : ms);
+    }
+
+    // 跟随设备电源状态切换低功耗模式（调用方需持有 log_mutex）
+    void update_power_state(TimePoint now) {
+        if (!follow_power.load(std::memory_order_relaxed) ||
+            (power_checked != TimePoint{} && now - power_checked < POWER_CHECK_INTERVAL)) {
+            return;
+        }
+        power_checked = now;
+        low_power_mode.store(read_power_state().low_power(), std::memory_order_relaxed);
+    }
+
+    // 按最近的写入速率调整批量阈值：突发写入时攒成更大的批次，减少写入次数（调用方需持有 log_mutex）
+    void update_batch_size(TimePoint now) {
+        double elapsed = std::chrono::duration<double>(now - rate_sampled).count();
+        if (elapsed >= 1.0) {
+            uint64_t appended = appended_bytes.load(std::memory_order_relaxed);
+            double rate = static_cast<double>(appended - rate_base_bytes) / elapsed;
+            write_rate = write_rate * 0.7 + rate * 0.3;
+            rate_base_bytes = appended;
+            rate_sampled = now;
+        }
+        size_t base = buffer_max_size.load(std::memory_order_relaxed);
+        if (low_power_mode.load(std::memory_order_relaxed)) {
+            base *= 4;
+        }
+        batch_size = std::clamp(static_cast<size_t>(write_rate * BATCH_WINDOW_S), base, base * MAX_BATCH_FACTOR);
+    }
+
+    // 刷新线程：等到最近的期限（缓冲区空闲刷新、统计输出、文件句柄关闭）为止，
+    // 没有待刷新的缓冲区时由 ERROR、队列过半或下一条记录唤醒，完全空闲时不会周期性醒来
+    void flush_thread_func() {
+        TimePoint flush_deadline = TimePoint::max();  // 最近的缓冲区空闲刷新期限
+        TimePoint other_deadline = TimePoint::max();  // 统计输出和文件句柄关闭的期限
+        while (running.load(std::memory_order_relaxed)) {
+            {
+                std::unique_lock<std::mutex> wake_lock(wake_mutex);
+                auto woken = [this] {
+                    return flush_requested || !running.load(std::memory_order_relaxed);
+                };
+                bool records_waiting = false;
+                if (flush_deadline == TimePoint::max()) {
+                    // 先声明等待再检查队列，与 enqueue 中的检查配对，入队的一方不会错过唤醒
+                    wake_on_record.store(true);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    records_waiting = ring.size() > 0;
+                }
+                if (!records_waiting) {
+                    TimePoint deadline = std::min(flush_deadline, other_deadline);
+                    if (deadline == TimePoint::max()) {
+                        wake_cv.wait(wake_lock, woken);
+                    } else {
+                        wake_cv.wait_until(wake_lock, deadline, woken);
+                    }
+                }
+                wake_on_record.store(false, std::memory_order_relaxed);
+                flush_requested = false;
+            }
+
+            if (!running.load(std::memory_order_relaxed)) {
+                break;
+            }
+
+            // 持有 log_mutex 排空队列并挑出需要刷新的日志，释放后再写文件，生产者和其他日志的刷新不必等待磁盘 I/O
+            std::vector<LogState*> due;
+            auto now = Clock::now();
+            auto idle = idle_limit();
+            {
+                MutexHold lock(*this);
+                ++wakeups;
+                update_power_state(now);
+                update_batch_size(now);
+                due = drain_ring(true);
+                if (ring.size() > 0) {
+                    request_flush();
+                }
+
+                for (auto& segment_pair : mapped_logs) {
+                    segment_pair.second->sync_if_requested();
+                }
+
+                // 定期输出运行统计（先于缓冲区检查，写入的统计记录参与下面的期限计算）
+                other_deadline = TimePoint::max();
+                if (unsigned dump_interval = stats_interval.load(std::memory_order_relaxed)) {
+                    if (now - last_stats_dump >= std::chrono::seconds(dump_interval)) {
+                        last_stats_dump = now;
+                        if (LogState* stats_log = dump_stats()) {
+                            if (std::find(due.begin(), due.end(), stats_log) == due.end()) {
+                                due.push_back(stats_log);
+                            }
+                        }
+                    }
+                    other_deadline = last_stats_dump + std::chrono::seconds(dump_interval);
+                }
+
+                // 空闲超时或超过半个批次的缓冲区立即刷新，其余的记下空闲期限；
+                // 恢复日志将满时持有其记录的缓冲区也立即刷新
+                flush_deadline = TimePoint::max();
+                size_t half_batch = batch_size / 2;
+                bool free_journal = journal_pressure.exchange(false, std::memory_order_relaxed);
+                for_each_log([&](LogState& log) {
+                    std::lock_guard<std::mutex> buffer_lock(log.buffer_mutex);
+                    const LogBuffer& buffer = log.buffer;
+                    if (buffer.size == 0 && !buffer.filter.pending()) {
+                        return;
+                    }
+                    if (now - buffer.last_write >= idle || buffer.size > half_batch ||
+                        (free_journal && !buffer.journal_entries.empty())) {
+                        if (std::find(due.begin(), due.end(), &log) == due.end()) {
+                            due.push_back(&log);
+                        }
+                    } else {
+                        flush_deadline = std::min(flush_deadline, buffer.last_write + idle);
+                    }
+                });
+            }
+            flush_logs(due);
+
+            // 收尾已完成的异步写入，未完成的等完成事件后再来；关闭长时间未使用的文件句柄
+            auto file_idle = idle * 3;
+            bool batches_in_flight = false;
+            for_each_log([&](LogState& log) {
+                std::lock_guard<std::mutex> file_lock(log.file_mutex);
+                if (!finish_batch(log, false)) {
+                    batches_in_flight = true;
+                    return;
+                }
+                if (log.file.fd < 0) {
+                    return;
+                }
+                if (now - log.file.last_access >= file_idle) {
+                    log.file.close_fd();
+                } else {
+                    other_deadline = std::min(other_deadline, log.file.last_access + file_idle);
+                }
+            });
+
+            // 在 eventfd 上等待完成事件（最长到下一个期限），醒来后立即再走一轮收尾。
+            // 等待期间的唤醒请求在写入完成后处理，与同步写入时阻塞在 writev 上相同
+            if (batches_in_flight) {
+                TimePoint deadline = std::min(flush_deadline, other_deadline);
+                int timeout_ms = -1;
+                if (deadline != TimePoint::max()) {
+                    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+                    timeout_ms = static_cast<int>(std::clamp<int64_t>(remaining, 0, INT_MAX));
+                }
+                uring.wait_any(timeout_ms);
+                request_flush();
+            }
+        }
+    }
+};
+
+// 解析套接字地址，名称以 '@' 开头时使用抽象命名空间
+inline socklen_t make_socket_address(std::string_view name, sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (name.empty() || name.size() >= sizeof(addr.sun_path)) {
+        return 0;
+    }
+
+    bool abstract_name = name[0] == '@';
+    std::memcpy(addr.sun_path, name.data(), name.size());
+    if (abstract_name) {
+        addr.sun_path[0] = '\0';
+    }
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + name.size() + (abstract_name ? 0 : 1));
+}
+
+// 套接字协议：每个数据报包含一条或多条记录
+//   记录格式: <op><name>\0<payload>\0
+//   op: '1'-'4' 按级别写入日志, 'F' 刷新缓冲区（name 为空时刷新全部）, 'C' 清理日志
+//   op: 'a'-'d' 带标签写入日志，payload 为 <tag>\0<message>
+//   op: 'W' 注册文件监控，name 为动作输出的日志名，payload 为 <path>\0<action>\0<options>，
+//           结果（"OK" 或拒绝原因）作为数据报回复给请求方
+//   op: 'U' 注销文件监控，payload 为路径
+//   op: 'X' 托管运行命令，name 为输出的日志名，payload 为动作（脚本路径或 "-c 命令"）
+//   op: 'S' 查询运行统计，payload 为 "text" 或 "json"，结果作为数据报回复给请求方，
+//           超出数据报大小的日志条目省略，省略数记为 logs_omitted
+// 日志客户端 - 将记录打包为数据报发送给守护进程
+class LogClient {
+public:
+    explicit LogClient(std::string_view name) {
+        addr_len = make_socket_address(name, addr);
+        if (addr_len != 0) {
+            fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        }
+        pending.reserve(4096);
+    }
+
+    ~LogClient() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // 套接字是否已创建（名称无效时为 false）
+    [[nodiscard]] bool is_open() const noexcept {
+        return fd >= 0;
+    }
+
+    // 追加一条记录；数据报已满时返回 false，需要先调用 send()
+    bool append(char op, std::string_view name, std::string_view payload, std::string_view tag = {}) {
+        // 带标签的记录使用小写操作码
+        size_t overhead = name.size() + 3;
+        if (!tag.empty() && op >= '0' + LOG_ERROR && op <= '0' + LOG_DEBUG) {
+            op = static_cast<char>(op - '1' + 'a');
+            overhead += tag.size() + 1;
+        } else {
+            tag = {};
+        }
+
+        // 单条记录不能超过一个数据报
+        size_t max_payload = MAX_DATAGRAM_SIZE - std::min(overhead, MAX_DATAGRAM_SIZE);
+        if (payload.size() > max_payload) {
+            payload = payload.substr(0, max_payload);
+        }
+
+        size_t record_size = overhead + payload.size();
+        if (!pending.empty() && pending.size() + record_size > MAX_DATAGRAM_SIZE) {
+            return false;
+        }
+
+        pending += op;
+        pending += name;
+        pending += '\0';
+        if (op >= 'a') {
+            pending += tag;
+            pending += '\0';
+        }
+        pending += payload;
+        pending += '\0';
+        return true;
+    }
+
+    // 发送已打包的记录，守护进程不可用时返回 false
+    bool send() {
+        if (pending.empty()) {
+            return true;
+        }
+        if (fd < 0) {
+            return false;
+        }
+
+        ssize_t ret;
+        do {
+            ret = sendto(fd, pending.data(), pending.size(), 0,
+                         reinterpret_cast<const sockaddr*>(&addr), addr_len);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret < 0) {
+            return false;
+        }
+        pending.clear();
+        return true;
+    }
+
+    // 发送请求并等待守护进程回复，客户端自动绑定一个抽象地址用于接收
+    bool request(char op, std::string_view payload, std::string& response, int timeout_ms = 2000) {
+        return request(op, {}, payload, response, timeout_ms);
+    }
+
+    bool request(char op, std::string_view name, std::string_view payload, std::string& response, int timeout_ms = 2000) {
+        if (fd < 0 || !pending.empty()) {
+            return false;
+        }
+        // 只绑定一次，同一客户端可多次请求
+        if (!bound) {
+            sockaddr_un local{};
+            local.sun_family = AF_UNIX;
+            if (bind(fd, reinterpret_cast<const sockaddr*>(&local), sizeof(sa_family_t)) != 0) {
+                return false;
+            }
+            bound = true;
+        }
+        if (!append(op, name, payload) || !send()) {
+            return false;
+        }
+        pollfd pfd{fd, POLLIN, 0};
+        int ready;
+        while ((ready = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR) {
+        }
+        if (ready <= 0) {
+            return false;
+        }
+        response.resize(MAX_DATAGRAM_SIZE);
+        ssize_t n = recv(fd, response.data(), response.size(), 0);
+        if (n < 0) {
+            return false;
+        }
+        response.resize(static_cast<size_t>(n));
+        return true;
+    }
+
+    // 取出尚未发送的日志记录并清空，守护进程不可用时由调用方直接写入文件。
+    // 参数：级别、日志名、标签、消息
+    template <typename Callback>
+    void take_pending(Callback&& callback) {
+        std::string_view data(pending);
+        while (!data.empty()) {
+            char op = data[0];
+            bool tagged = op >= 'a' && op <= 'a' + LOG_DEBUG - 1;
+            size_t name_end = data.find('\0', 1);
+            if (name_end == std::string_view::npos) {
+                break;
+            }
+            size_t tag_end = tagged ? data.find('\0', name_end + 1) : name_end;
+            if (tag_end == std::string_view::npos) {
+                break;
+            }
+            size_t payload_end = data.find('\0', tag_end + 1);
+            if (payload_end == std::string_view::npos) {
+                break;
+            }
+            int level = tagged ? op - 'a' + 1 : op - '0';
+            if (level >= LOG_ERROR && level <= LOG_DEBUG) {
+                std::string_view tag = tagged ? data.substr(name_end + 1, tag_end - name_end - 1) : std::string_view();
+                callback(static_cast<LogLevel>(level), data.substr(1, name_end - 1), tag,
+                         data.substr(tag_end + 1, payload_end - tag_end - 1));
+            }
+            data.remove_prefix(payload_end + 1);
+        }
+        pending.clear();
+    }
+
+private:
+    int fd{-1};
+    bool bound{false};
+    sockaddr_un addr;
+    socklen_t addr_len{0};
+    std::string pending;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+// 日志时间戳格式化
+// 每个线程缓存 "YYYY-MM-DD HH:MM:" 前缀，同一分钟内只修改秒和小数位，
+// 热路径上没有锁和 localtime_r 调用。时区偏移均为整分钟，按分钟缓存是安全的。
+
+// 时间戳精度（小数位数）
+enum TimePrecision {
+    TIME_SECONDS = 0,
+    TIME_MILLIS = 3,
+    TIME_MICROS = 6
+};
+
+// 解析精度名称: s / ms / us
+[[nodiscard]] inline bool parse_time_precision(const char* name, TimePrecision& precision) noexcept {
+    if (name[0] == 's' && name[1] == '\0') {
+        precision = TIME_SECONDS;
+    } else if (name[0] == 'm' && name[1] == 's' && name[2] == '\0') {
+        precision = TIME_MILLIS;
+    } else if (name[0] == 'u' && name[1] == 's' && name[2] == '\0') {
+        precision = TIME_MICROS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 格式化时间戳，返回线程私有缓冲区，下次调用前有效
+[[nodiscard]] inline const char* format_time(std::chrono::system_clock::time_point tp,
+                                             TimePrecision precision = TIME_SECONDS) noexcept {
+    static constexpr size_t PREFIX_LEN = 17; // "YYYY-MM-DD HH:MM:"
+
+    struct Cache {
+        int64_t minute{INT64_MIN};
+        int second{-1};
+        char buffer[32];
+    };
+    thread_local Cache cache;
+
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(tp.time_since_epoch()).count();
+    int64_t seconds = us / 1000000;
+    int64_t fraction = us % 1000000;
+    if (fraction < 0) {
+        fraction += 1000000;
+        --seconds;
+    }
+    int64_t minute = seconds / 60;
+    int second = static_cast<int>(seconds % 60);
+    if (second < 0) {
+        second += 60;
+        --minute;
+    }
+
+    // 分钟变化时重新生成日期前缀
+    if (minute != cache.minute) {
+        std::time_t minute_time = static_cast<std::time_t>(minute * 60);
+        std::tm now_tm;
+        localtime_r(&minute_time, &now_tm);
+        std::strftime(cache.buffer, sizeof(cache.buffer), "%Y-%m-%d %H:%M:", &now_tm);
+        cache.minute = minute;
+        cache.second = -1;
+    }
+
+    // 只修改变化的秒数字
+    if (second != cache.second) {
+        cache.buffer[PREFIX_LEN] = static_cast<char>('0' + second / 10);
+        cache.buffer[PREFIX_LEN + 1] = static_cast<char>('0' + second % 10);
+        cache.second = second;
+    }
+
+    char* end = cache.buffer + PREFIX_LEN + 2;
+    if (precision != TIME_SECONDS) {
+        // 截取所需的小数位
+        for (int i = precision; i < TIME_MICROS; ++i) {
+            fraction /= 10;
+        }
+        *end++ = '.';
+        for (int i = precision - 1; i >= 0; --i) {
+            end[i] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+        end += precision;
+    }
+    *end = '\0';
+    return cache.buffer;
+}
@@ -7,566 +7,1164 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
 #include <condition_variable>
 #include <atomic>
 #include <memory>
 #include <csignal>
 #include <format>       // C++20 format
+#include <cstring>      // strerror, memcpy
+#include <cstddef>      // offsetof
+#include <array>
+#include <tuple>
+#include <algorithm>
+#include <charconv>     // from_chars
+#include <regex>        // -c run 的级别匹配
 
 // Linux 特定头文件
 #include <sys/stat.h>   // stat, mkdir, chmod
+#include <sys/socket.h> // socket, bind, sendto, recv
+#include <sys/un.h>     // sockaddr_un
+#include <zlib.h>       // gzip
+#include <fcntl.h>      // open
+#include <poll.h>       // poll
 #include <dirent.h>     // opendir, readdir, closedir
 #include <unistd.h>     // access, remove, rename, rmdir, umask
 #include <cerrno>       // errno
+#include <sys/eventfd.h> // eventfd
+#include <sys/signalfd.h> // signalfd
 
-// 日志级别定义
-enum LogLevel {
-    LOG_ERROR = 1,
-    LOG_WARN = 2,
-    LOG_INFO = 3,
-    LOG_DEBUG = 4
-};
-
-// 高性能、低功耗日志系统
-class Logger {
-private:
-    // 使用 string_view 优化字符串处理
-    using StringView = std::string_view;
-    
-    // 使用 steady_clock 获得更好的性能
-    using Clock = std::chrono::steady_clock;
-    using TimePoint = Clock::time_point;
-    
-    // 原子变量减少锁竞争
-    std::atomic_bool running{true};
-    std::atomic_bool low_power_mode{false};
-    std::atomic<unsigned int> max_idle_time{30000}; // ms
-    std::atomic<size_t> buffer_max_size{8192};      // bytes
-    std::atomic<size_t> log_size_limit{102400};     // bytes
-    std::atomic<int> log_level{LOG_INFO};           // default level
-
-    // 日志目录
-    std::string log_dir;
-
-    // 互斥锁和条件变量
-    std::mutex log_mutex;
-    std::condition_variable cv;
-
-    // 文件缓存
-    struct LogFile {
-        std::ofstream stream;
-        TimePoint last_access;
-        size_t current_size{0};
-    };
-    std::map<std::string, std::unique_ptr<LogFile>> log_files;
-
-    // 优化的缓冲区 - 使用预分配内存
-    struct LogBuffer {
-        std::string content;
-        size_t size{0};
-        TimePoint last_write;
-
-        LogBuffer() {
-            // 预分配内存减少重新分配
-            content.reserve(16384); // 初始预分配 16KB
-        }
-    };
-    std::map<std::string, std::unique_ptr<LogBuffer>> log_buffers;
-
-    // 线程控制
-    std::unique_ptr<std::thread> flush_thread;
-
-    // 时间格式化缓存 - 减少格式化开销
-    char time_buffer[32];
-    std::chrono::system_clock::time_point last_time_format;
-    std::mutex time_mutex;
+#include "log_engine.hpp"
+#include "watch_engine.hpp"
 
+// 守护进程托管的文件监控：监控引擎在独立线程中运行，监控项经控制套接字注册，
+// 动作和托管命令的标准输出按 INFO、标准错误按 WARN 逐行写入指定日志。
+// 第一次注册时才启动线程；SIGCHLD 需在创建任何线程之前屏蔽
+class WatchHost {
 public:
-    // 使用 string_view 优化构造函数
-    Logger(StringView dir, int level = LOG_INFO, size_t size_limit = 102400)
-        : log_dir(dir)
-        , log_level(level)
-        , log_size_limit(size_limit) {
+    static constexpr int RETRY_INTERVAL_MS = 30000;  // 无法挂载的监控项的重试间隔
+    static constexpr size_t MAX_ACTIONS = 4;          // 同时运行的监控动作
+    static constexpr size_t MAX_SUPERVISED = 64;      // 托管的常驻命令
 
-        // 创建日志目录
-        create_log_directory();
+    explicit WatchHost(Logger& logger) : logger(logger) {}
 
-        // 初始化时间缓存
-        {
-            std::lock_guard<std::mutex> lock(time_mutex);
-            last_time_format = std::chrono::system_clock::now();
-            update_time_cache();
-        }
+    ~WatchHost() {
+        stop();
+    }
+
+    WatchHost(const WatchHost&) = delete;
+    WatchHost& operator=(const WatchHost&) = delete;
 
-        // 启动刷新线程
-        flush_thread = std::make_unique<std::thread>(&Logger::flush_thread_func, this);
+    // 注册监控项，同一路径重复注册时替换旧的监控项。监控引擎无法启动时返回 false
+    bool add_watch(std::string_view log_name, WatchSpec spec) {
+        spec.action.log_name = log_name;
+        return post({COMMAND_ADD, std::move(spec)});
     }
 
-    ~Logger() {
-        stop();
+    void remove_watch(std::string_view path) {
+        WatchSpec spec;
+        spec.path = normalize_path(std::string(path));
+        post({COMMAND_REMOVE, std::move(spec)});
+    }
 
-        if (flush_thread && flush_thread->joinable()) {
-            flush_thread->join();
-        }
+    // 立即启动一个托管命令，不受监控动作并发数限制
+    void spawn(std::string_view log_name, Action action) {
+        WatchSpec spec;
+        spec.action = std::move(action);
+        spec.action.log_name = log_name;
+        post({COMMAND_SPAWN, std::move(spec)});
     }
 
-    // 停止日志系统
     void stop() {
-        bool expected = true;
-        if (running.compare_exchange_strong(expected, false, std::memory_order_relaxed)) {
-            cv.notify_all();
-
-            {
-                std::lock_guard<std::mutex> lock(log_mutex);
-                for (auto& buffer_pair : log_buffers) {
-                    if (buffer_pair.second && buffer_pair.second->size > 0) {
-                        flush_buffer_internal(buffer_pair.first);
-                    }
-                }
-                log_files.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!thread.joinable()) {
+                return;
             }
+            stopping = true;
         }
+        wake();
+        thread.join();
+        close(event_fd);
+        event_fd = -1;
     }
 
-    // 设置最大空闲时间（毫秒）
-    void set_max_idle_time(unsigned int ms) {
-        max_idle_time.store(ms, std::memory_order_relaxed);
-    }
+private:
+    enum CommandKind {
+        COMMAND_ADD,
+        COMMAND_REMOVE,
+        COMMAND_SPAWN
+    };
 
-    // 设置缓冲区大小
-    void set_buffer_size(size_t size) {
-        buffer_max_size.store(size, std::memory_order_relaxed);
-    }
+    struct Command {
+        CommandKind kind;
+        WatchSpec spec;
+    };
 
-    // 设置日志级别
-    void set_log_level(int level) {
-        log_level.store(level, std::memory_order_relaxed);
-    }
+    enum EngineState {
+        ENGINE_STARTING,
+        ENGINE_RUNNING,
+        ENGINE_FAILED
+    };
 
-    // 设置日志文件大小限制
-    void set_log_size_limit(size_t limit) {
-        log_size_limit.store(limit, std::memory_order_relaxed);
+    Logger& logger;
+    std::mutex mutex;
+    std::condition_variable started_cv;
+    std::vector<Command> commands;
+    std::thread thread;
+    bool stopping{false};
+    EngineState engine_state{ENGINE_STARTING};
+    int event_fd{-1};
+
+    void wake() {
+        uint64_t one = 1;
+        while (write(event_fd, &one, sizeof(one)) < 0 && errno == EINTR) {}
     }
 
-    // 设置低功耗模式
-    void set_low_power_mode(bool enabled) {
-        low_power_mode.store(enabled, std::memory_order_relaxed);
+    // 交给监控线程执行，第一次调用时启动线程并等待监控引擎初始化完成
+    bool post(Command command) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (stopping) {
+                return false;
+            }
+            if (!thread.joinable()) {
+                event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (event_fd < 0) {
+                    logger.write_log("filewatch", LOG_ERROR, "Cannot create watch host eventfd");
+                    return false;
+                }
+                thread = std::thread(&WatchHost::run, this);
+                started_cv.wait(lock, [this] { return engine_state != ENGINE_STARTING; });
+            }
+            if (engine_state == ENGINE_FAILED) {
+                return false;
+            }
+            commands.push_back(std::move(command));
+        }
+        wake();
+        return true;
+    }
 
-        if (enabled) {
-            max_idle_time.store(60000, std::memory_order_relaxed);
-            buffer_max_size.store(32768, std::memory_order_relaxed);
-        } else {
-            max_idle_time.store(30000, std::memory_order_relaxed);
-            buffer_max_size.store(8192, std::memory_order_relaxed);
+    void report_started(bool ok) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            engine_state = ok ? ENGINE_RUNNING : ENGINE_FAILED;
         }
-        cv.notify_one();
+        started_cv.notify_all();
     }
 
-    // 写入日志 - 优化版本
-    void write_log(StringView log_name, LogLevel level, StringView message) {
-        if (static_cast<int>(level) > log_level.load(std::memory_order_relaxed)) {
+    void run() {
+        sigset_t child_signal;
+        sigemptyset(&child_signal);
+        sigaddset(&child_signal, SIGCHLD);
+        int signal_fd = signalfd(-1, &child_signal, SFD_NONBLOCK | SFD_CLOEXEC);
+
+        WatchEngine engine({});
+        Debouncer debouncer{std::chrono::milliseconds(500), std::chrono::milliseconds(3000)};
+        Executor executor(MAX_ACTIONS);
+        Executor supervisor(MAX_SUPERVISED);
+        ContentTracker tracker;
+        int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (signal_fd < 0 || epoll_fd < 0 || !engine.open() || !debouncer.open() ||
+            !executor.open() || !supervisor.open()) {
+            logger.write_format("filewatch", LOG_ERROR, "Cannot start watch engine ({})", strerror(errno));
+            if (signal_fd >= 0) close(signal_fd);
+            if (epoll_fd >= 0) close(epoll_fd);
+            report_started(false);
             return;
         }
-        if (!running.load(std::memory_order_relaxed)) {
-            return;
+        report_started(true);
+
+        auto sink = [this](const std::string& log_name, int stream, std::string_view line) {
+            logger.write_log(log_name, stream == STDERR_FILENO ? LOG_WARN : LOG_INFO, line);
+        };
+        executor.set_output_sink(sink);
+        supervisor.set_output_sink(sink);
+
+        enum : uint32_t {
+            SOURCE_COMMAND = 1u << 0,
+            SOURCE_INOTIFY = 1u << 1,
+            SOURCE_DEBOUNCE = 1u << 2,
+            SOURCE_SIGNAL = 1u << 3,
+            SOURCE_DEADLINE = 1u << 4,
+            SOURCE_OUTPUT = 1u << 5
+        };
+        const std::pair<int, uint32_t> sources[] = {
+            {event_fd, SOURCE_COMMAND},
+            {engine.fd(), SOURCE_INOTIFY},
+            {debouncer.fd(), SOURCE_DEBOUNCE},
+            {signal_fd, SOURCE_SIGNAL},
+            {executor.deadline_fd(), SOURCE_DEADLINE},
+            {supervisor.deadline_fd(), SOURCE_DEADLINE},
+            {executor.output_fd(), SOURCE_OUTPUT},
+            {supervisor.output_fd(), SOURCE_OUTPUT},
+        };
+        for (const auto& source : sources) {
+            struct epoll_event event {};
+            event.events = EPOLLIN;
+            event.data.u32 = source.second;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, source.first, &event);
         }
 
-        // 获取级别字符串
-        const char* level_str = get_level_string(level);
+        std::vector<Command> pending_commands;
+        std::vector<Trigger> triggers;
+        std::vector<Batch> due;
+        size_t next_spawn = 0;
+        struct epoll_event events[8];
+        while (true) {
+            int timeout = engine.has_pending() ? RETRY_INTERVAL_MS : -1;
+            int count = epoll_wait(epoll_fd, events, 8, timeout);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            uint32_t ready = 0;
+            for (int i = 0; i < count; ++i) {
+                ready |= events[i].data.u32;
+            }
 
-        // 获取格式化时间
-        const char* time_str = get_formatted_time();
+            triggers.clear();
+            if (ready & SOURCE_COMMAND) {
+                uint64_t value;
+                while (read(event_fd, &value, sizeof(value)) < 0 && errno == EINTR) {}
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (stopping) {
+                        break;
+                    }
+                    pending_commands.swap(commands);
+                }
+                for (auto& command : pending_commands) {
+                    apply(command, engine, tracker, supervisor, next_spawn);
+                }
+                pending_commands.clear();
+            }
 
-        // 优化日志条目构造
-        std::string log_entry;
-        log_entry.reserve(strlen(time_str) + strlen(level_str) + message.size() + 10);
+            if (count == 0) {
+                engine.arm_pending(triggers, false);
+            }
+            if (ready & SOURCE_INOTIFY) {
+                if (!engine.read_events(triggers)) break;
+                if (engine.has_pending()) {
+                    engine.arm_pending(triggers, false);
+                }
+            }
+            if (!triggers.empty()) {
+                debouncer.add(triggers, Debouncer::Clock::now());
+            }
+
+            if (ready & SOURCE_DEBOUNCE) {
+                due.clear();
+                debouncer.collect_due(due, Debouncer::Clock::now());
+                for (auto& batch : due) {
+                    const WatchSpec& spec = engine.watch_specs()[batch.spec];
+                    if (spec.removed || (spec.hash && !tracker.filter(spec, batch))) {
+                        continue;
+                    }
+                    executor.submit(batch.spec, spec.action, std::move(batch));
+                }
+            }
 
-        log_entry += time_str;
-        log_entry += " [";
-        log_entry += level_str;
-        log_entry += "] ";
-        log_entry += message;
-        log_entry += "\n";
+            if (ready & SOURCE_SIGNAL) {
+                struct signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {}
+                executor.reap();
+                supervisor.reap();
+            }
+            if (ready & SOURCE_DEADLINE) {
+                executor.expire();
+                supervisor.expire();
+            }
+            if (ready & SOURCE_OUTPUT) {
+                executor.drain_output();
+                supervisor.drain_output();
+            }
+        }
 
-        // 添加到缓冲区
-        add_to_buffer(std::string(log_name), std::move(log_entry), level);
+        // 仍在运行的动作和托管命令保留，随守护进程一起由系统回收
+        close(epoll_fd);
+        close(signal_fd);
     }
 
-    // 批量写入日志 - 高效版本
-    void batch_write(StringView log_name, const std::vector<std::pair<LogLevel, std::string>>& entries) {
-        if (entries.empty() || !running.load(std::memory_order_relaxed)) return;
+    void apply(Command& command, WatchEngine& engine, ContentTracker& tracker,
+               Executor& supervisor, size_t& next_spawn) {
+        WatchSpec& spec = command.spec;
+        if (command.kind == COMMAND_SPAWN) {
+            Batch batch{next_spawn, {}, false, Executor::Clock::now(), {}};
+            spec.action.policy = POLICY_QUEUE;
+            spec.action.timeout = 0;
+            supervisor.submit(next_spawn++, spec.action, std::move(batch));
+            return;
+        }
+
+        const auto& specs = engine.watch_specs();
+        for (size_t i = 0; i < specs.size(); ++i) {
+            if (!specs[i].removed && specs[i].path == spec.path) {
+                engine.remove_spec(i);
+            }
+        }
+        if (command.kind == COMMAND_REMOVE) {
+            logger.write_format("filewatch", LOG_INFO, "Stopped watching {}", spec.path);
+            return;
+        }
 
-        // 过滤有效条目并计算总大小
-        std::vector<std::pair<LogLevel, const std::string*>> valid_entries;
-        valid_entries.reserve(entries.size());
+        if (spec.action.policy == POLICY_DEFAULT) spec.action.policy = POLICY_QUEUE;
+        if (spec.action.timeout < 0) spec.action.timeout = 0;
+        size_t index = engine.add_spec(std::move(spec));
+        const WatchSpec& added = engine.watch_specs()[index];
+        if (added.hash && !added.is_dir) {
+            tracker.prime(added.path, added.keys);
+        }
+        logger.write_format("filewatch", LOG_INFO, "{} {} -> {}", added.root_wd >= 0 ? "Watching" : "Waiting for",
+                            added.path, added.action.command);
+    }
+};
 
-        size_t total_size = 0;
-        bool has_error = false;
-        int current_log_level = log_level.load(std::memory_order_relaxed);
+// 日志守护进程 - 接收客户端数据报，协议见 log_engine.hpp
+class LogServer {
+public:
+    explicit LogServer(std::string_view name) : socket_name(name) {}
 
-        for (const auto& entry : entries) {
-            if (static_cast<int>(entry.first) <= current_log_level) {
-                valid_entries.emplace_back(entry.first, &entry.second);
-                total_size += entry.second.size() + 50;
-                if (entry.first == LOG_ERROR) has_error = true;
+    ~LogServer() {
+        if (fd >= 0) {
+            close(fd);
+            if (socket_name[0] != '@') {
+                unlink(socket_name.c_str());
             }
         }
+    }
 
-        if (valid_entries.empty()) return;
+    // 绑定套接字
+    bool open_socket() {
+        sockaddr_un addr;
+        socklen_t addr_len = make_socket_address(socket_name, addr);
+        if (addr_len == 0) {
+            std::cerr << "Error: Invalid socket name: " << socket_name << std::endl;
+            return false;
+        }
 
-        // 获取格式化时间
-        const char* time_str = get_formatted_time();
+        fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            std::cerr << "Cannot create log socket (" << strerror(errno) << ")" << std::endl;
+            return false;
+        }
 
-        // 构建批量日志内容
-        std::string batch_content;
-        batch_content.reserve(total_size);
+        // 文件系统套接字可能是上次残留的：能连上说明守护进程仍在运行，连接被拒绝时才删除
+        if (socket_name[0] != '@') {
+            int probe = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+            bool in_use = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&addr), addr_len) == 0;
+            bool stale = !in_use && errno == ECONNREFUSED;
+            if (probe >= 0) {
+                close(probe);
+            }
+            if (in_use) {
+                std::cerr << "Logging daemon already running on socket: " << socket_name << std::endl;
+                close(fd);
+                fd = -1;
+                return false;
+            }
+            if (stale) {
+                unlink(socket_name.c_str());
+            }
+        }
 
-        for (const auto& entry : valid_entries) {
-            const char* level_str = get_level_string(entry.first);
-            batch_content += time_str;
-            batch_content += " [";
-            batch_content += level_str;
-            batch_content += "] ";
-            batch_content += *entry.second;
-            batch_content += "\n";
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), addr_len) != 0) {
+            if (errno == EADDRINUSE) {
+                std::cerr << "Logging daemon already running on socket: " << socket_name << std::endl;
+            } else {
+                std::cerr << "Cannot bind log socket: " << socket_name << " (" << strerror(errno) << ")" << std::endl;
+            }
+            close(fd);
+            fd = -1;
+            return false;
         }
 
-        // 添加到缓冲区
-        add_to_buffer(std::string(log_name), std::move(batch_content), has_error ? LOG_ERROR : LOG_INFO);
+        // 加大接收缓冲区，吸收启动阶段的突发日志
+        int rcvbuf = 262144;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        return true;
     }
 
-    // 刷新指定日志缓冲区
-    void flush_buffer(const std::string& log_name) {
-        std::lock_guard<std::mutex> lock(log_mutex);
-        flush_buffer_internal(log_name);
-    }
+    // 服务主循环，收到 SIGTERM 或 SIGINT 时返回，由调用方停止日志系统。
+    // 这两个信号须已在所有线程中屏蔽，经 signalfd 在此处理
+    bool serve(Logger& logger, WatchHost& watches) {
+        std::vector<char> buffer(MAX_DATAGRAM_SIZE);
+        sigset_t stop_signals;
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGTERM);
+        sigaddset(&stop_signals, SIGINT);
+        int signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signal_fd < 0) {
+            std::cerr << "Cannot create signal fd (" << strerror(errno) << ")" << std::endl;
+            return false;
+        }
+        pollfd pfds[] = {{fd, POLLIN, 0}, {signal_fd, POLLIN, 0}};
 
-    // 刷新所有日志缓冲区
-    void flush_all() {
-        std::lock_guard<std::mutex> lock(log_mutex);
-        for (auto it = log_buffers.begin(); it != log_buffers.end(); ++it) {
-            if (it->second && it->second->size > 0) {
-                flush_buffer_internal(it->first);
+        while (logger.is_running()) {
+            int ret = poll(pfds, 2, -1);
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "Log socket poll failed (" << strerror(errno) << ")" << std::endl;
+                break;
             }
-        }
-        for (auto& file_pair : log_files) {
-            if (file_pair.second && file_pair.second->stream.is_open()) {
-                file_pair.second->stream.flush();
+            if (pfds[1].revents & POLLIN) {
+                struct signalfd_siginfo info;
+                if (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    logger.write_format("system", LOG_INFO, "Received signal {}", info.ssi_signo);
+                    break;
+                }
+            }
+
+            // 一次唤醒尽量取完所有待处理数据报
+            while (true) {
+                sockaddr_un from;
+                socklen_t from_len = sizeof(from);
+                ssize_t n = recvfrom(fd, buffer.data(), buffer.size(), MSG_DONTWAIT,
+                                     reinterpret_cast<sockaddr*>(&from), &from_len);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    break;
+                }
+                handle_datagram(logger, watches, std::string_view(buffer.data(), static_cast<size_t>(n)), from, from_len);
             }
         }
+        close(signal_fd);
+        return true;
     }
 
-    // 清理所有日志
-    void clean_logs() {
-        std::lock_guard<std::mutex> lock(log_mutex);
+private:
+    std::string socket_name;
+    int fd{-1};
+    // 已驻留的日志名，只由服务线程访问；驻留失败的名称不缓存，缓存大小不超过日志数上限
+    std::unordered_map<std::string, Logger::LogId, Logger::NameHash, std::equal_to<>> log_ids;
+
+    // 按缓存的 id 写入，首次出现的名称按名称写入（被级别过滤的记录不创建日志）后再缓存
+    void write_record(Logger& logger, std::string_view name, LogLevel level, std::string_view message,
+                      std::string_view tag) {
+        auto it = log_ids.find(name);
+        if (it != log_ids.end()) {
+            logger.write_log(it->second, level, message, tag);
+            return;
+        }
+        logger.write_log(name, level, message, tag);
+        Logger::LogId id = logger.find_log_id(name);
+        if (id != Logger::INVALID_LOG) {
+            log_ids.emplace(name, id);
+        }
+    }
 
-        // 关闭并清理所有文件和缓冲区
-        log_files.clear();
-        log_buffers.clear();
+    // 读取 end 之后的下一个字段，并将 end 移到该字段的结尾
+    static std::string_view next_field(std::string_view data, size_t& end) {
+        size_t start = std::min(end + 1, data.size());
+        end = std::min(data.find('\0', start), data.size());
+        return data.substr(start, end - start);
+    }
 
-        // 删除日志文件
-        DIR *dir = opendir(log_dir.c_str());
-        if (!dir) {
-            std::cerr << "Cannot open log directory for cleaning: " << log_dir << " (" << strerror(errno) << ")" << std::endl;
-            std::string cmd = "rm -f \"" + log_dir + "\"/*.log \"" + log_dir + "\"/*.log.old";
-            system(cmd.c_str());
+    // 回复请求方，请求方未绑定地址时无法回复
+    void reply(const sockaddr_un& to, socklen_t to_len, std::string_view data) {
+        if (to_len <= sizeof(sa_family_t)) {
             return;
         }
+        data = data.substr(0, MAX_DATAGRAM_SIZE);
+        sendto(fd, data.data(), data.size(), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>(&to), to_len);
+    }
 
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != nullptr) {
-            std::string filename = entry->d_name;
-            if (filename == "." || filename == "..") {
-                continue;
+    // 解析并处理一个数据报
+    void handle_datagram(Logger& logger, WatchHost& watches, std::string_view data,
+                         const sockaddr_un& from, socklen_t from_len) {
+        while (!data.empty()) {
+            char op = data[0];
+            size_t name_end = data.find('\0', 1);
+            if (name_end == std::string_view::npos) {
+                return;
             }
-
-            // 检查是否为 .log 或 .log.old 文件
-            bool is_log_file = false;
-            size_t len = filename.length();
-            if (len > 4 && filename.substr(len - 4) == ".log") {
-                is_log_file = true;
-            } else if (len > 7 && filename.substr(len - 7) == ".log.old") {
-                is_log_file = true;
+            size_t payload_end = data.find('\0', name_end + 1);
+            if (payload_end == std::string_view::npos) {
+                payload_end = data.size();
             }
 
-            if (is_log_file) {
-                std::string full_path = log_dir + "/" + filename;
-                if (remove(full_path.c_str()) != 0) {
-                    std::cerr << "Cannot delete log file: " << full_path << " (" << strerror(errno) << ")" << std::endl;
+            std::string_view name = data.substr(1, name_end - 1);
+            std::string_view payload = data.substr(name_end + 1, payload_end - name_end - 1);
+
+            if (op >= '0' + LOG_ERROR && op <= '0' + LOG_DEBUG) {
+                if (!name.empty()) {
+                    write_record(logger, name, static_cast<LogLevel>(op - '0'), payload, {});
+                }
+            } else if (op >= 'a' && op < 'a' + LOG_DEBUG) {
+                // 带标签的记录还包含一个字段
+                std::string_view tag = payload;
+                payload_end = data.find('\0', payload_end + 1);
+                if (payload_end == std::string_view::npos) {
+                    payload_end = data.size();
+                }
+                size_t message_start = name_end + tag.size() + 2;
+                std::string_view message = message_start <= payload_end
+                    ? data.substr(message_start, payload_end - message_start)
+                    : std::string_view();
+                if (!name.empty()) {
+                    write_record(logger, name, static_cast<LogLevel>(op - 'a' + 1), message, tag);
+                }
+            } else if (op == 'W') {
+                // 监控注册还包含动作和选项两个字段，结果回复给请求方
+                std::string_view action = next_field(data, payload_end);
+                std::string_view options = next_field(data, payload_end);
+
+                WatchSpec spec;
+                spec.path = normalize_path(std::string(payload));
+                spec.action = parse_action(std::string(action));
+                if (name.empty() || spec.path.empty() || spec.action.command.empty() ||
+                    !parse_watch_options(std::string(options), spec)) {
+                    logger.write_format("filewatch", LOG_WARN, "Rejected invalid watch registration: {}", spec.path);
+                    reply(from, from_len, "invalid watch registration");
+                } else if (!watches.add_watch(name, std::move(spec))) {
+                    reply(from, from_len, "watch engine unavailable");
+                } else {
+                    reply(from, from_len, "OK");
+                }
+            } else if (op == 'U') {
+                watches.remove_watch(payload);
+            } else if (op == 'X') {
+                Action action = parse_action(std::string(payload));
+                if (!name.empty() && !action.command.empty()) {
+                    watches.spawn(name, std::move(action));
+                }
+            } else if (op == 'S') {
+                reply(from, from_len, logger.stats(payload == "json", MAX_DATAGRAM_SIZE));
+            } else if (op == 'F') {
+                // 指定日志名时只刷新该日志
+                if (name.empty()) {
+                    logger.flush_all();
+                } else {
+                    logger.flush_buffer(std::string(name));
                 }
+            } else if (op == 'C') {
+                logger.clean_logs();
             }
+
+            data.remove_prefix(std::min(payload_end + 1, data.size()));
         }
-        closedir(dir);
     }
+};
 
-    // 主循环检查的辅助函数
-    [[nodiscard]] bool is_running() const noexcept {
-        return running.load(std::memory_order_relaxed);
+// 全局日志实例
+static std::unique_ptr<Logger> g_logger;
+
+// 遍历逗号分隔的名称列表
+template <typename Callback>
+static void for_each_name(std::string_view names, Callback&& callback) {
+    while (!names.empty()) {
+        size_t end = std::min(names.find(','), names.size());
+        if (end > 0) {
+            callback(names.substr(0, end));
+        }
+        names.remove_prefix(std::min(end + 1, names.size()));
     }
+}
 
-private:
-    // 创建日志目录
-    void create_log_directory() {
-        struct stat st;
-        // 检查目录是否存在
-        if (stat(log_dir.c_str(), &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                // 目录存在，检查权限
-                if (access(log_dir.c_str(), W_OK | X_OK) != 0) {
-                    std::cerr << "Warning: Insufficient permissions for log directory: " << log_dir << " (" << strerror(errno) << ")" << std::endl;
-                    chmod(log_dir.c_str(), 0755);
-                }
-                return;
-            } else {
-                std::cerr << "Error: Log path exists but is not a directory: " << log_dir << std::endl;
-                log_dir = "./logs";
-                std::cerr << "Trying alternative log directory: " << log_dir << std::endl;
-                if (stat(log_dir.c_str(), &st) != 0) {
-                    // 替代目录也不存在
-                } else if (!S_ISDIR(st.st_mode)) {
-                    std::cerr << "Error: Alternative log path also exists but is not a directory: " << log_dir << std::endl;
-                    throw std::runtime_error("Cannot initialize log directory");
-                } else {
-                    // 替代目录存在且是目录
-                    return;
-                }
-            }
+// 写出全部数据到标准输出
+static bool write_stdout(std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = write(STDOUT_FILENO, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
         }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+    return true;
+}
 
-        // 尝试创建目录
-        std::string cmd = "mkdir -p \"" + log_dir + "\"";
-        int ret = system(cmd.c_str());
-        if (ret != 0) {
-            std::cerr << "Cannot create log directory (using system): " << log_dir << std::endl;
-            if (stat(log_dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
-                std::cerr << "Error: Failed to create log directory, please check permissions or path." << std::endl;
-                throw std::runtime_error("Cannot create log directory");
-            }
+// 目录中实际存在的最高历史代（NAME.N 或 NAME.N.gz），守护进程的 -g 可能与命令行不同
+static unsigned highest_generation(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+    std::string_view base = std::string_view(path).substr(slash == std::string::npos ? 0 : slash + 1);
+
+    unsigned highest = 0;
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        return 0;
+    }
+    while (dirent* entry = readdir(handle)) {
+        std::string_view name = entry->d_name;
+        if (name.size() <= base.size() + 1 || !name.starts_with(base) || name[base.size()] != '.') {
+            continue;
+        }
+        name.remove_prefix(base.size() + 1);
+        if (name.ends_with(".gz")) {
+            name.remove_suffix(3);
         }
-        
-        if (chmod(log_dir.c_str(), 0755) != 0) {
-            std::cerr << "Warning: Cannot set log directory permissions: " << log_dir << " (" << strerror(errno) << ")" << std::endl;
+        unsigned generation = 0;
+        auto [end, ec] = std::from_chars(name.data(), name.data() + name.size(), generation);
+        if (ec == std::errc() && end == name.data() + name.size()) {
+            highest = std::max(highest, generation);
         }
     }
+    closedir(handle);
+    return highest;
+}
 
-    // 获取日志级别字符串
-    [[nodiscard]] constexpr const char* get_level_string(LogLevel level) const noexcept {
-        switch (level) {
-            case LOG_ERROR: return "ERROR";
-            case LOG_WARN:  return "WARN";
-            case LOG_INFO:  return "INFO";
-            case LOG_DEBUG: return "DEBUG";
-            default:        return "UNKNOWN";
-        }
+// 以文本格式输出日志文件：二进制日志逐块解码，文本日志原样输出，gzip 压缩的历史代透明解压
+static bool cat_log_file(const std::string& path, TimePrecision precision) {
+    if (access(path.c_str(), R_OK) != 0) {
+        return false;
+    }
+    gzFile in = gzopen(path.c_str(), "rb");
+    if (!in) {
+        return false;
     }
+    gzbuffer(in, 65536);
+
+    std::vector<char> buffer(65536);
+    std::string out;
+    out.reserve(buffer.size() * 2);
+    binlog::Decoder decoder(precision);
+    size_t pending = 0;
+    bool checked_magic = false;
+    bool binary = false;
+
+    while (true) {
+        int n = gzread(in, buffer.data() + pending, static_cast<unsigned>(buffer.size() - pending));
+        if (n <= 0) {
+            break;
+        }
+        pending += static_cast<size_t>(n);
 
-    // 获取格式化时间字符串
-    [[nodiscard]] const char* get_formatted_time() {
-        std::lock_guard<std::mutex> lock(time_mutex);
+        std::string_view data(buffer.data(), pending);
+        if (!checked_magic) {
+            if (pending < binlog::MAGIC_SIZE) {
+                continue;
+            }
+            checked_magic = true;
+            binary = binlog::valid_magic(data);
+            if (binary) {
+                data.remove_prefix(binlog::MAGIC_SIZE);
+            }
+        }
 
-        auto now = std::chrono::system_clock::now();
-        if (now - last_time_format < std::chrono::seconds(1)) {
-            return time_buffer;
+        if (!binary) {
+            write_stdout(data);
+            pending = 0;
+            continue;
         }
 
-        last_time_format = now;
-        update_time_cache();
-        return time_buffer;
+        // 解码完整记录，不完整的尾部移到缓冲区开头
+        size_t consumed = decoder.decode(data, out);
+        write_stdout(out);
+        out.clear();
+        size_t offset = static_cast<size_t>(data.data() - buffer.data()) + consumed;
+        pending -= offset;
+        std::memmove(buffer.data(), buffer.data() + offset, pending);
+
+        // 单条记录超过缓冲区时扩容
+        if (pending == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
     }
 
-    // 更新时间缓存
-    void update_time_cache() {
-        auto now_time = std::chrono::system_clock::to_time_t(last_time_format);
-        std::tm now_tm;
-        localtime_r(&now_time, &now_tm);
-        std::strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", &now_tm);
+    // 不足文件头长度的短文本文件
+    if (!checked_magic && pending > 0) {
+        write_stdout(std::string_view(buffer.data(), pending));
     }
 
-    // 添加内容到缓冲区
-    void add_to_buffer(const std::string& log_name, std::string&& content, LogLevel level) {
-        std::lock_guard<std::mutex> lock(log_mutex);
+    gzclose(in);
+    return true;
+}
 
-        // 确保缓冲区存在
-        auto buffer_it = log_buffers.find(log_name);
-        if (buffer_it == log_buffers.end()) {
-            buffer_it = log_buffers.emplace(log_name, std::make_unique<LogBuffer>()).first;
+// 解析批处理文件中的级别字段：数字 1-4 或 ERROR/WARN/INFO/DEBUG
+static bool parse_batch_level(std::string_view text, LogLevel& level) {
+    int value = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec == std::errc() && result.ptr == text.data() + text.size()) {
+        if (value < LOG_ERROR || value > LOG_DEBUG) {
+            return false;
         }
+        level = static_cast<LogLevel>(value);
+        return true;
+    }
+    static constexpr std::string_view names[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+    for (int i = 0; i < 4; ++i) {
+        if (text == names[i]) {
+            level = static_cast<LogLevel>(LOG_ERROR + i);
+            return true;
+        }
+    }
+    return false;
+}
 
-        auto& buffer = buffer_it->second;
-        buffer->content.append(std::move(content));
-        buffer->size = buffer->content.size();
-        buffer->last_write = Clock::now();
+// -c run 的子进程，终止信号转发给它
+static pid_t g_run_child = -1;
 
-        // 考虑立即刷新
-        bool is_low_power = low_power_mode.load(std::memory_order_relaxed);
-        size_t current_max_size = buffer_max_size.load(std::memory_order_relaxed);
+static void forward_signal(int sig) {
+    if (g_run_child > 0) {
+        kill(g_run_child, sig);
+    }
+}
 
-        if ((level == LOG_ERROR) || (!is_low_power && buffer->size >= current_max_size)) {
-            flush_buffer_internal(log_name);
-        }
+// 输出行匹配到正则时使用指定级别，否则标准输出为 INFO、标准错误为 WARN
+struct LevelRule {
+    std::regex pattern;
+    LogLevel level;
+};
 
-        cv.notify_one();
+// 运行命令并把标准输出/错误按行交给 sink(level, line)，返回命令的退出码。
+// 两个管道扩容后用 poll 同时读取，读完一轮调用 flush() 让调用方发送攒下的记录
+template <typename Sink, typename Flush>
+static int run_command(char* const argv[], const std::vector<LevelRule>& rules, Sink&& sink, Flush&& flush) {
+    int out_pipe[2];
+    int err_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) != 0) {
+        return 127;
     }
-
-    // 内部缓冲区刷新方法
-    void flush_buffer_internal(const std::string& log_name) {
-        auto buffer_it = log_buffers.find(log_name);
-        if (buffer_it == log_buffers.end() || !buffer_it->second || buffer_it->second->size == 0) {
-            return;
+    if (pipe2(err_pipe, O_CLOEXEC) != 0) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return 127;
+    }
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawn_file_actions_adddup2(&file_actions, out_pipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&file_actions, err_pipe[1], STDERR_FILENO);
+    pid_t pid = -1;
+    int err = posix_spawnp(&pid, argv[0], &file_actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&file_actions);
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    if (err != 0) {
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        sink(LOG_ERROR, std::string("Cannot run ") + argv[0] + ": " + strerror(err));
+        flush();
+        return 127;
+    }
+    g_run_child = pid;
+    signal(SIGTERM, forward_signal);
+    signal(SIGHUP, forward_signal);
+    signal(SIGINT, SIG_IGN);  // 终端中断已送达同一进程组的子进程，继续读完它的输出
+
+    struct pollfd fds[2] = {{out_pipe[0], POLLIN, 0}, {err_pipe[0], POLLIN, 0}};
+    LineReader readers[2] = {LineReader(32768), LineReader(32768)};  // 小于一个数据报
+    for (auto& entry : fds) {
+        grow_pipe(entry.fd);
+        fcntl(entry.fd, F_SETFL, fcntl(entry.fd, F_GETFL) | O_NONBLOCK);
+    }
+    int open_count = 2;
+    while (open_count > 0) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (fds[i].fd < 0 || fds[i].revents == 0) {
+                continue;
+            }
+            LogLevel stream_level = i == 0 ? LOG_INFO : LOG_WARN;
+            bool open = readers[i].read(fds[i].fd, [&](std::string_view line) {
+                LogLevel level = stream_level;
+                for (const auto& rule : rules) {
+                    if (std::regex_search(line.begin(), line.end(), rule.pattern)) {
+                        level = rule.level;
+                        break;
+                    }
+                }
+                sink(level, line);
+            });
+            if (!open) {
+                close(fds[i].fd);
+                fds[i].fd = -1;  // poll 忽略负的 fd
+                --open_count;
+            }
         }
+        flush();
+    }
 
-        auto& buffer = buffer_it->second;
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    g_run_child = -1;
+    int code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) {
+        sink(LOG_WARN, std::string(argv[0]) + " killed by signal " + std::to_string(WTERMSIG(status)));
+    } else {
+        sink(code == 0 ? LOG_INFO : LOG_WARN, std::string(argv[0]) + " exited with " + std::to_string(code));
+    }
+    flush();
+    return code;
+}
 
-        // 构建日志文件路径
-        std::string log_path = log_dir + "/" + log_name + ".log";
+// 读取文件 [offset, offset + limit) 追加到 out，返回读取的字节数。
+// 内存映射段末尾预分配的填充零不计入
+static size_t read_log_range(int fd, uint64_t offset, size_t limit, std::string& out) {
+    size_t start = out.size();
+    out.resize(start + limit);
+    size_t total = 0;
+    while (total < limit) {
+        ssize_t n = pread(fd, out.data() + start + total, limit - total, static_cast<off_t>(offset + total));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        total += static_cast<size_t>(n);
+    }
+    while (total > 0 && out[start + total - 1] == '\0') {
+        --total;
+    }
+    out.resize(start + total);
+    return total;
+}
 
-        // 获取或创建日志文件对象
-        auto file_it = log_files.find(log_name);
-        if (file_it == log_files.end()) {
-            file_it = log_files.emplace(log_name, std::make_unique<LogFile>()).first;
+// 增量读取文本日志（-c tail）：输出头行 "OFFSET INODE RESET" 和之后的新内容，
+// 调用方下次以输出的 OFFSET/INODE 继续。since 为负数时返回末尾 max_bytes 内的完整行。
+// inode 与当前文件不同说明发生过轮换：先读完上一代中剩余的内容，再从新文件开头继续；
+// 找不到上一代或文件被截断时从头读取，RESET 为 1 表示调用方应丢弃已有内容。
+// follow_ms > 0 时没有新内容则等待文件变化，最长 follow_ms 毫秒；
+// 刷新请求只在开始和文件没有变化时发送，文件变化时直接读取新内容
+static bool tail_log_file(const std::string& path, int64_t since, uint64_t inode, size_t max_bytes,
+                          int follow_ms, const std::function<void()>& request_flush) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(follow_ms, 0));
+    int watch_fd = -1;
+    std::string data;
+    uint64_t offset = 0;
+    uint64_t result_inode = 0;
+    bool reset = false;
+    bool flush_needed = true;
+    std::string file_name = path.substr(path.find_last_of('/') + 1);
+
+    while (true) {
+        if (flush_needed) {
+            request_flush();
         }
-        auto& log_file = file_it->second;
-
-        // 检查文件大小并处理轮换
-        size_t current_log_size_limit = log_size_limit.load(std::memory_order_relaxed);
-        if (log_file->stream.is_open() && log_file->current_size > current_log_size_limit) {
-            log_file->stream.close();
-
-            // 轮换日志文件
-            std::string old_log_path = log_path + ".old";
+        data.clear();
+        reset = false;
 
-            // 检查旧文件是否存在，如果存在则删除
-            if (access(old_log_path.c_str(), F_OK) == 0) {
-                if (remove(old_log_path.c_str()) != 0) {
-                    std::cerr << "Cannot delete old file during log rotation: " << old_log_path << " (" << strerror(errno) << ")" << std::endl;
-                }
+        struct stat st{};
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0 && errno != ENOENT) {
+            return false;
+        }
+        if (fd >= 0 && fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        // 文件不存在时视为空；内存映射段末尾预分配的填充零不计入
+        uint64_t size = fd >= 0 ? MappedSegment::content_length(fd, static_cast<size_t>(st.st_size)) : 0;
+        size_t budget = max_bytes;
+        result_inode = st.st_ino;
+
+        if (since < 0) {
+            // 首次读取：只取末尾，丢弃不完整的首行
+            offset = size > max_bytes ? size - max_bytes : 0;
+            size_t n = fd >= 0 ? read_log_range(fd, offset, budget, data) : 0;
+            if (offset > 0) {
+                size_t line_end = data.find('\n');
+                data.erase(0, line_end == std::string::npos ? data.size() : line_end + 1);
             }
-
-            // 重命名当前日志文件为旧文件
-            if (access(log_path.c_str(), F_OK) == 0) {
-                if (rename(log_path.c_str(), old_log_path.c_str()) != 0) {
-                    std::cerr << "Cannot rename file during log rotation: " << log_path << " -> " << old_log_path << " (" << strerror(errno) << ")" << std::endl;
-                    std::string cmd = "mv -f \"" + log_path + "\" \"" + old_log_path + "\"";
-                    system(cmd.c_str());
+            offset += n;
+        } else {
+            offset = static_cast<uint64_t>(since);
+            bool in_previous = false;
+            if (inode != 0 && inode != st.st_ino) {
+                // 已轮换：在上一代中找到原来的文件，读完其中剩余的内容
+                int old_fd = -1;
+                struct stat old_st{};
+                for (const std::string& old_path : {generation_path(path, 1, false), path + ".old"}) {
+                    int candidate = open(old_path.c_str(), O_RDONLY | O_CLOEXEC);
+                    if (candidate >= 0 && fstat(candidate, &old_st) == 0 && old_st.st_ino == inode) {
+                        old_fd = candidate;
+                        break;
+                    }
+                    if (candidate >= 0) {
+                        close(candidate);
+                    }
+                }
+                if (old_fd >= 0) {
+                    uint64_t old_size = static_cast<uint64_t>(old_st.st_size);
+                    size_t n = offset < old_size
+                        ? read_log_range(old_fd, offset, std::min<uint64_t>(budget, old_size - offset), data)
+                        : 0;
+                    close(old_fd);
+                    if (n == budget) {
+                        // 预算已用完，下次继续读上一代
+                        in_previous = true;
+                        offset += n;
+                        result_inode = inode;
+                    } else {
+                        budget -= n;
+                        offset = 0;
+                    }
+                } else {
+                    reset = true;
+                    offset = 0;
                 }
+            } else if (offset > size) {
+                reset = true;  // 文件被截断或清理
+                offset = 0;
             }
+            if (!in_previous && fd >= 0) {
+                offset += read_log_range(fd, offset, budget, data);
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
 
-            log_file->current_size = 0;
+        auto now = std::chrono::steady_clock::now();
+        if (!data.empty() || reset || follow_ms <= 0 || now >= deadline) {
+            break;
         }
 
-        // 确保文件已打开
-        if (!log_file->stream.is_open()) {
-            log_file->stream.open(log_path, std::ios::app | std::ios::binary);
-            if (!log_file->stream.is_open()) {
-                std::cerr << "Cannot open log file for writing: " << log_path << " (" << strerror(errno) << ")" << std::endl;
-                buffer->content.clear();
-                buffer->size = 0;
-                return;
+        // 等待日志目录中的变化；内存映射段的写入不产生事件，因此最多每秒重新检查一次
+        if (watch_fd < 0) {
+            watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            std::string dir = path.substr(0, path.find_last_of('/') + 1);
+            if (watch_fd >= 0) {
+                inotify_add_watch(watch_fd, dir.empty() ? "." : dir.c_str(), IN_MODIFY | IN_CREATE | IN_MOVED_TO);
             }
-
-            // 获取当前文件大小
-            log_file->stream.seekp(0, std::ios::end);
-            std::streampos pos = log_file->stream.tellp();
-            if (pos == static_cast<std::streampos>(-1)) {
-                log_file->current_size = 0;
-                std::cerr << "Warning: Cannot get log file size: " << log_path << std::endl;
-            } else {
-                log_file->current_size = static_cast<size_t>(pos);
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+        pollfd pfd{watch_fd, POLLIN, 0};
+        poll(&pfd, watch_fd >= 0 ? 1 : 0, static_cast<int>(std::min<int64_t>(remaining, 1000)));
+        alignas(inotify_event) char events[4096];
+        bool changed = false;
+        ssize_t length;
+        while (watch_fd >= 0 && (length = read(watch_fd, events, sizeof(events))) > 0) {
+            for (ssize_t pos = 0; pos < length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(events + pos);
+                changed = changed || (event->len > 0 && file_name == event->name);
+                pos += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
             }
         }
-
-        // 写入缓冲区内容
-        log_file->stream.write(buffer->content.c_str(), buffer->content.size());
-        if (log_file->stream.fail()) {
-            std::cerr << "Failed to write to log file: " << log_path << std::endl;
-            log_file->stream.close();
-            log_file->current_size = 0;
-            buffer->content.clear();
-            buffer->size = 0;
-        } else {
-            log_file->stream.flush();
-            log_file->current_size += buffer->size;
-            log_file->last_access = Clock::now();
-
-            buffer->content.clear();
-            buffer->size = 0;
+        flush_needed = !changed;
+        if (since < 0) {
+            since = static_cast<int64_t>(offset);  // 首次读取为空时按当前末尾继续等待
+            inode = result_inode;
         }
     }
+    if (watch_fd >= 0) {
+        close(watch_fd);
+    }
 
-    // 优化的刷新线程函数
-    void flush_thread_func() {
-        while (running.load(std::memory_order_relaxed)) {
-            std::unique_lock<std::mutex> lock(log_mutex);
-
-            bool is_low_power = low_power_mode.load(std::memory_order_relaxed);
-            auto wait_time = is_low_power ? std::chrono::seconds(60) : std::chrono::seconds(15);
+    std::string header = std::to_string(offset) + ' ' + std::to_string(result_inode) + ' ' + (reset ? '1' : '0') + '\n';
+    return write_stdout(header) && write_stdout(data);
+}
 
-            cv.wait_for(lock, wait_time, [this] {
-                return !running.load(std::memory_order_relaxed);
-            });
+// 查询条件（-c query）
+struct LogQuery {
+    int max_level{LOG_DEBUG};
+    int64_t from_ms{INT64_MIN};  // 时间范围（闭区间），用于跳过索引块
+    int64_t to_ms{INT64_MAX};
+    std::string from_text;       // 同一范围的 "YYYY-MM-DD HH:MM:SS" 形式，与行首时间戳直接比较
+    std::string to_text;
+    std::string pattern;
+    size_t limit{1000};          // 最多输出最近的 limit 行，0 表示不限
+};
 
-            if (!running.load(std::memory_order_relaxed)) {
-                break;
+// 解析查询时间: 秒级时间戳，或本地时间 "YYYY-MM-DD[ HH:MM[:SS]]"。
+// 作为结束时间时省略的部分取该时段的末尾
+static bool parse_query_time(const char* text, bool end, int64_t& ms, std::string& formatted) {
+    char* digits_end = nullptr;
+    long long epoch = std::strtoll(text, &digits_end, 10);
+    time_t seconds;
+    if (*text != '\0' && *digits_end == '\0') {
+        seconds = static_cast<time_t>(epoch);
+    } else {
+        std::tm tm{};
+        int fields = sscanf(text, "%d-%d-%d%*[ T]%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                            &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+        if (fields != 3 && fields != 5 && fields != 6) {
+            return false;
+        }
+        if (end && fields < 6) {
+            tm.tm_sec = 59;
+            if (fields == 3) {
+                tm.tm_hour = 23;
+                tm.tm_min = 59;
             }
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        tm.tm_isdst = -1;
+        seconds = mktime(&tm);
+        if (seconds == static_cast<time_t>(-1)) {
+            return false;
+        }
+    }
+    ms = static_cast<int64_t>(seconds) * 1000 + (end ? 999 : 0);
 
-            unsigned int current_idle_ms = max_idle_time.load(std::memory_order_relaxed);
-            size_t current_max_buffer_size = buffer_max_size.load(std::memory_order_relaxed);
-            auto now = Clock::now();
-
-            // 检查每个缓冲区，如果满足条件则刷新
-            for (auto it = log_buffers.begin(); it != log_buffers.end(); /* no increment here */) {
-                auto current_it = it++;
-                if (!current_it->second) continue;
+    std::tm local;
+    char buffer[32];
+    localtime_r(&seconds, &local);
+    formatted.assign(buffer, std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local));
+    return true;
+}
 
-                auto& buffer = current_it->second;
-                if (buffer->size == 0) continue;
+// 解析文本记录行首 "YYYY-MM-DD HH:MM:SS[.ffffff] [LEVEL] "，返回级别；不是记录的首行时返回 0
+static int parse_record_header(std::string_view line) {
+    if (line.size() < 23 || line[4] != '-' || line[10] != ' ' || line[13] != ':' || line[16] != ':') {
+        return 0;
+    }
+    size_t pos = 19;
+    if (line[pos] == '.') {
+        do {
+            ++pos;
+        } while (pos < line.size() && line[pos] >= '0' && line[pos] <= '9');
+    }
+    if (line.substr(pos, 2) != " [") {
+        return 0;
+    }
+    std::string_view rest = line.substr(pos + 2);
+    for (int level = LOG_ERROR; level <= LOG_DEBUG; ++level) {
+        std::string_view name = get_level_string(static_cast<LogLevel>(level));
+        if (rest.size() > name.size() && rest.starts_with(name) && rest[name.size()] == ']') {
+            return level;
+        }
+    }
+    return 0;
+}
 
-                auto idle_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    now - buffer->last_write);
+// 在由完整行组成的文本中查找满足条件的行，按顺序交给 emit。
+// 续行（消息中的换行）沿用所属记录的级别和时间；有关键字时用 memmem 直接跳到下一个命中处
+template <typename Emit>
+static void scan_log_text(std::string_view data, const LogQuery& query, Emit&& emit) {
+    auto accept = [&](int level, std::string_view header) {
+        if (level == 0) {
+            // 无法识别的内容只在没有级别和时间条件时输出
+            return query.max_level >= LOG_DEBUG && query.from_text.empty() && query.to_text.empty();
+        }
+        std::string_view time = header.substr(0, 19);
+        return level <= query.max_level && (query.from_text.empty() || time >= query.from_text) &&
+               (query.to_text.empty() || time <= query.to_text);
+    };
+    auto line_end = [&](size_t from) {
+        const void* newline = memchr(data.data() + from, '\n', data.size() - from);
+        return newline ? static_cast<size_t>(static_cast<const char*>(newline) - data.data()) : data.size();
+    };
 
-                if (idle_duration.count() > current_idle_ms || buffer->size > current_max_buffer_size / 2) {
-                    flush_buffer_internal(current_it->first);
-                }
+    if (query.pattern.empty()) {
+        int level = 0;
+        std::string_view header;
+        for (size_t pos = 0; pos < data.size();) {
+            size_t end = line_end(pos);
+            std::string_view line = data.substr(pos, end - pos);
+            if (int parsed = parse_record_header(line)) {
+                level = parsed;
+                header = line;
             }
+            if (accept(level, header)) {
+                emit(line);
+            }
+            pos = end + 1;
+        }
+        return;
+    }
 
-            // 关闭长时间未使用的文件句柄
-            unsigned int file_idle_ms = current_idle_ms * 3;
-            for (auto it = log_files.begin(); it != log_files.end(); /* no increment here */) {
-                auto current_it = it++;
-                if (!current_it->second) {
-                    continue;
-                }
-
-                if (!current_it->second->stream.is_open()) {
-                    continue;
-                }
+    for (size_t pos = 0; pos < data.size();) {
+        const void* hit = memmem(data.data() + pos, data.size() - pos, query.pattern.data(), query.pattern.size());
+        if (!hit) {
+            break;
+        }
+        size_t at = static_cast<size_t>(static_cast<const char*>(hit) - data.data());
+        const void* newline = memrchr(data.data() + pos, '\n', at - pos);
+        size_t start = newline ? static_cast<size_t>(static_cast<const char*>(newline) - data.data()) + 1 : pos;
+        size_t end = line_end(at);
+        std::string_view line = data.substr(start, end - start);
+
+        // 命中续行时向前找到所属记录的首行
+        std::string_view header = line;
+        int level = parse_record_header(header);
+        for (size_t header_start = start; level == 0 && header_start > 0;) {
+            size_t header_end = header_start - 1;
+            newline = memrchr(data.data(), '\n', header_end);
+            header_start = newline ? static_cast<size_t>(static_cast<const char*>(newline) - data.data()) + 1 : 0;
+            header = data.substr(header_start, header_end - header_start);
+            level = parse_record_header(header);
+        }
+        if (accept(level, header)) {
+            emit(line);
+        }
+        pos = end + 1;
+    }
+}
 
-                auto file_idle_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    now - current_it->second->last_access);
+// 查询一个日志文件（可以是 gzip 压缩的历史代），匹配的行按文件内顺序追加到 out。
+// 有索引时只读取级别和时间范围可能满足条件的块，索引没有覆盖的部分全文扫描
+static bool query_log_file(const std::string& path, const LogQuery& query, std::vector<std::string>& out) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    bool compressed = path.ends_with(".gz");
+    auto entries = logindex::load(logindex::path_for(path), compressed ? UINT64_MAX : static_cast<uint64_t>(st.st_size));
 
-                if (file_idle_duration.count() > file_idle_ms) {
-                    current_it->second->stream.close();
-                }
-            }
+    // 需要读取的区间，length 为 UINT64_MAX 表示读到文件末尾
+    struct Range {
+        uint64_t offset;
+        uint64_t length;
+    };
+    std::vector<Range> ranges;
+    auto add_range = [&](uint64_t offset, uint64_t length) {
+        if (!ranges.empty() && ranges.back().offset + ranges.back().length == offset) {
+            ranges.back().length = length == UINT64_MAX ? UINT64_MAX : ranges.back().length + length;
+        } else {
+            ranges.push_back({offset, length});
+        }
+    };
+    auto level_mask = static_cast<uint8_t>((1u << query.max_level) - 1);
+    uint64_t covered = 0;
+    for (const auto& entry : entries) {
+        if (entry.offset > covered) {
+            add_range(covered, entry.offset - covered);
+        }
+        if ((entry.levels & level_mask) != 0 && entry.max_ms >= query.from_ms && entry.min_ms <= query.to_ms) {
+            add_range(entry.offset, entry.length);
         }
+        covered = entry.offset + entry.length;
     }
-};
+    add_range(covered, UINT64_MAX);
 
-// 全局日志实例
-static std::unique_ptr<Logger> g_logger;
+    gzFile in = gzopen(path.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    gzbuffer(in, 65536);
 
-// 信号处理函数
-void signal_handler(int sig) {
-    if (g_logger) {
-        if (sig == SIGTERM || sig == SIGINT) {
-            g_logger->flush_all();
-            g_logger->stop();
+    auto emit = [&](std::string_view line) {
+        out.emplace_back(line);
+    };
+    std::string buffer;
+    for (const auto& range : ranges) {
+        // 压缩文件向前定位时解压并丢弃中间的数据，不做匹配
+        if (gzseek(in, static_cast<z_off_t>(range.offset), SEEK_SET) < 0) {
+            break;
         }
-    }
+        uint64_t remaining = range.length;
+        buffer.clear();
+        while (remaining > 0) {
+            size_t start = buffer.size();
+            size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, 262144));
+            buffer.resize(start + want);
+            int n = gzread(in, buffer.data() + start, static_cast<unsigned>(want));
+            if (n <= 0) {
+                buffer.resize(start);
+                break;
+            }
+            buffer.resize(start + static_cast<size_t>(n));
+            if (remaining != UINT64_MAX) {
+                remaining -= static_cast<uint64_t>(n);
+            }
 
-    if (sig == SIGTERM || sig == SIGINT) {
-        _exit(0);
+            // 只扫描完整的行，不完整的尾部留到下一轮
+            size_t complete = buffer.rfind('\n') + 1;
+            scan_log_text(std::string_view(buffer).substr(0, complete), query, emit);
+            buffer.erase(0, complete);
+        }
+        // 内存映射段末尾预分配的填充零不计入
+        while (!buffer.empty() && buffer.back() == '\0') {
+            buffer.pop_back();
+        }
+        scan_log_text(buffer, query, emit);
     }
+    gzclose(in);
+    return true;
 }
 
 // 主函数
@@ -575,9 +1173,36 @@ int main(int argc, char* argv[]) {
     int log_level_int = LOG_INFO;
     std::string command;
     std::string log_name = "system";
+    bool log_name_given = false;
+    std::string watch_path;
+    std::string watch_options;
+    std::vector<LevelRule> level_rules;
+    char** run_argv = nullptr;
     std::string message;
     std::string batch_file;
+    std::string socket_name = DEFAULT_SOCKET_NAME;
+    OverflowPolicy overflow_policy = OVERFLOW_BLOCK;
+    std::string mapped_names;
+    std::string binary_names;
+    std::string tag;
+    std::string precision_spec;
+    size_t segment_size = 0;
+    unsigned generations = 5;
+    size_t dir_budget = 8 * 1024 * 1024;
     bool low_power = false;
+    bool follow_power = false;
+    bool async_io = false;
+    size_t journal_size = 262144;
+    std::string rate_spec;
+    bool dedup = false;
+    bool json_output = false;
+    unsigned stats_interval = 0;
+    int64_t tail_since = -1;
+    uint64_t tail_inode = 0;
+    size_t tail_max_bytes = 65536;
+    bool tail_follow = false;
+    int tail_timeout_ms = 5000;
+    LogQuery query;
 
     // 解析命令行参数
     for (int i = 1; i < argc; ++i) {
@@ -603,29 +1228,157 @@ int main(int argc, char* argv[]) {
             command = argv[++i];
         } else if (arg == "-n" && i + 1 < argc) {
             log_name = argv[++i];
+            log_name_given = true;
+        } else if (arg == "-w" && i + 1 < argc) {
+            watch_path = argv[++i];
+        } else if (arg == "-O" && i + 1 < argc) {
+            watch_options = argv[++i];
+        } else if ((arg == "-e" || arg == "-W") && i + 1 < argc) {
+            try {
+                level_rules.push_back({std::regex(argv[++i], std::regex::extended | std::regex::optimize),
+                                       arg == "-e" ? LOG_ERROR : LOG_WARN});
+            } catch (const std::regex_error& e) {
+                std::cerr << "Error: Invalid regular expression: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--since" && i + 1 < argc) {
+            tail_since = std::strtoll(argv[++i], nullptr, 10);
+        } else if (arg == "--inode" && i + 1 < argc) {
+            tail_inode = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--max-bytes" && i + 1 < argc) {
+            tail_max_bytes = std::max<size_t>(std::strtoul(argv[++i], nullptr, 10), 1);
+        } else if (arg == "--follow") {
+            tail_follow = true;
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            tail_timeout_ms = static_cast<int>(std::max(0L, std::strtol(argv[++i], nullptr, 10)));
+        } else if (arg == "--level" || arg.starts_with("--level=") || arg.starts_with("--level<=")) {
+            // 也接受 "--level<=2" 写法（需加引号避免被 shell 当作重定向）
+            std::string value = arg == "--level" ? (i + 1 < argc ? argv[++i] : "") : arg.substr(arg.find('=') + 1);
+            LogLevel level;
+            if (!parse_batch_level(value, level)) {
+                std::cerr << "Error: Invalid query level: " << value << std::endl;
+                return 1;
+            }
+            query.max_level = level;
+        } else if ((arg == "--from" || arg == "--to") && i + 1 < argc) {
+            bool end = arg == "--to";
+            if (!parse_query_time(argv[++i], end, end ? query.to_ms : query.from_ms, end ? query.to_text : query.from_text)) {
+                std::cerr << "Error: Invalid time (expected epoch seconds or 'YYYY-MM-DD HH:MM:SS'): " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--grep" && i + 1 < argc) {
+            query.pattern = argv[++i];
+        } else if (arg == "--limit" && i + 1 < argc) {
+            query.limit = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--") {
+            if (i + 1 < argc) {
+                run_argv = argv + i + 1;
+            }
+            break;
         } else if (arg == "-m" && i + 1 < argc) {
             message = argv[++i];
         } else if (arg == "-b" && i + 1 < argc) {
             batch_file = argv[++i];
+        } else if (arg == "-s" && i + 1 < argc) {
+            socket_name = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "block") {
+                overflow_policy = OVERFLOW_BLOCK;
+            } else if (policy == "drop-oldest") {
+                overflow_policy = OVERFLOW_DROP_OLDEST;
+            } else if (policy == "drop-debug") {
+                overflow_policy = OVERFLOW_DROP_DEBUG;
+            } else {
+                std::cerr << "Error: Invalid overflow policy: " << policy << std::endl;
+                return 1;
+            }
+        } else if (arg == "-t" && i + 1 < argc) {
+            tag = argv[++i];
+        } else if (arg == "-T" && i + 1 < argc) {
+            precision_spec = argv[++i];
+        } else if (arg == "-B" && i + 1 < argc) {
+            binary_names = argv[++i];
+        } else if (arg == "-M" && i + 1 < argc) {
+            mapped_names = argv[++i];
+        } else if (arg == "-S" && i + 1 < argc) {
+            segment_size = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-g" && i + 1 < argc) {
+            generations = static_cast<unsigned>(std::max(1L, std::strtol(argv[++i], nullptr, 10)));
+        } else if (arg == "-z" && i + 1 < argc) {
+            dir_budget = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-R" && i + 1 < argc) {
+            rate_spec = argv[++i];
+        } else if (arg == "-D") {
+            dedup = true;
+        } else if (arg == "-J" && i + 1 < argc) {
+            journal_size = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-j") {
+            json_output = true;
+        } else if (arg == "-i" && i + 1 < argc) {
+            stats_interval = static_cast<unsigned>(std::max(0L, std::strtol(argv[++i], nullptr, 10)));
         } else if (arg == "-p") {
             low_power = true;
+        } else if (arg == "-P") {
+            follow_power = true;
+        } else if (arg == "-A") {
+            async_io = true;
         } else if (arg == "-h" || arg == "--help") {
             std::cout << "Usage: " << argv[0] << " [options]" << std::endl;
             std::cout << "Options:" << std::endl;
             std::cout << "  -d DIR    Specify log directory (default: /data/adb/modules/AMMF2/logs)" << std::endl;
             std::cout << "  -l LEVEL  Set log level (1=Error, 2=Warn, 3=Info, 4=Debug, default: 3)" << std::endl;
-            std::cout << "  -c CMD    Execute command (daemon, write, batch, flush, clean)" << std::endl;
+            std::cout << "  -c CMD    Execute command (daemon, write, batch, flush, clean, cat, tail, query, watch, unwatch, spawn, run, stats)" << std::endl;
             std::cout << "  -n NAME   Specify log name (for write/batch commands, default: system)" << std::endl;
             std::cout << "  -m MSG    Log message content (for write command)" << std::endl;
-            std::cout << "  -b FILE   Batch input file, format: level|message (one per line, for batch command)" << std::endl;
+            std::cout << "  -t TAG    Source tag attached to the record (for write command)" << std::endl;
+            std::cout << "  -b FILE   Batch input file, format: level|message (one per line, '-' or omitted = stdin)" << std::endl;
+            std::cout << "  -s SOCKET Daemon socket (default: " << DEFAULT_SOCKET_NAME << ", '@' = abstract namespace)" << std::endl;
+            std::cout << "  -o POLICY Queue overflow policy (block, drop-oldest, drop-debug, default: block)" << std::endl;
+            std::cout << "  -B NAMES  Comma-separated log names stored in compact binary format (.blog, daemon)" << std::endl;
+            std::cout << "  -T SPEC   Timestamp precision s/ms/us, e.g. 'ms' or 'gpu-scheduler=us,service=ms'" << std::endl;
+            std::cout << "  -M NAMES  Comma-separated log names written through memory-mapped segments (daemon)" << std::endl;
+            std::cout << "  -S BYTES  Memory-mapped segment size (default: 102400)" << std::endl;
+            std::cout << "  -g COUNT  Rotated generations to keep, .2 and older are gzip-compressed (default: 5)" << std::endl;
+            std::cout << "  -z BYTES  Log directory byte budget, oldest generations are evicted first (default: 8388608, 0 = unlimited)" << std::endl;
+            std::cout << "  -R SPEC   Rate limits in records/s, e.g. '50/200' or 'gpu-scheduler=20,service:DEBUG=5/10'" << std::endl;
+            std::cout << "            ([LOG][:LEVEL]=RATE[/BURST], burst defaults to rate; suppressed records are summarized)" << std::endl;
+            std::cout << "  -D        Collapse repeated messages into 'Message repeated N times' summaries" << std::endl;
+            std::cout << "  -J BYTES  Crash journal for unflushed records, replayed on the next start (daemon, default: 262144, 0 = off)" << std::endl;
+            std::cout << "  -A        Write logs asynchronously through io_uring, falls back to writev when unavailable (daemon)" << std::endl;
+            std::cout << "  --since OFFSET  Byte offset to continue from, omitted = last --max-bytes (for tail command)" << std::endl;
+            std::cout << "  --inode INODE   Inode returned by the previous tail, detects rotation (for tail command)" << std::endl;
+            std::cout << "  --max-bytes N   Most bytes returned by one tail (default: 65536)" << std::endl;
+            std::cout << "  --follow        Wait for new content when there is none (for tail command)" << std::endl;
+            std::cout << "  --timeout MS    Longest wait with --follow (default: 5000)" << std::endl;
+            std::cout << "  --level N       Only records at level N or more severe, 1-4 or ERROR/WARN/INFO/DEBUG (for query command)" << std::endl;
+            std::cout << "  --from TIME     Only records at or after TIME, epoch seconds or 'YYYY-MM-DD HH:MM:SS' (for query command)" << std::endl;
+            std::cout << "  --to TIME       Only records at or before TIME (for query command)" << std::endl;
+            std::cout << "  --grep TEXT     Only lines containing TEXT (for query command)" << std::endl;
+            std::cout << "  --limit K       Print at most the K most recent matching lines (default: 1000, 0 = unlimited)" << std::endl;
+            std::cout << "  -j        Print statistics as JSON (for stats command)" << std::endl;
+            std::cout << "  -i SECS   Write statistics to the logmonitor.stats log every SECS seconds (daemon, default: 0 = off)" << std::endl;
+            std::cout << "  -w PATH   File or directory to watch (for watch/unwatch commands)" << std::endl;
+            std::cout << "  -O OPTS   Watch options, e.g. 'recursive,include=*.sh,keys' (for watch command)" << std::endl;
+            std::cout << "  -e REGEX  Output lines matching REGEX are logged as Error (for run command)" << std::endl;
+            std::cout << "  -W REGEX  Output lines matching REGEX are logged as Warn (for run command)" << std::endl;
+            std::cout << "  -- CMD    Command and arguments to run (for run command)" << std::endl;
             std::cout << "  -p        Enable low power mode (reduce write frequency)" << std::endl;
+            std::cout << "  -P        Follow device power state: low power mode while discharging with the screen off (daemon)" << std::endl;
             std::cout << "  -h        Show help information" << std::endl;
             std::cout << "Example:" << std::endl;
             std::cout << "  Start daemon: " << argv[0] << " -c daemon -d /path/to/logs -l 4 -p" << std::endl;
             std::cout << "  Write log: " << argv[0] << " -c write -n main -m \"Test message\" -l 3" << std::endl;
             std::cout << "  Batch write: " << argv[0] << " -c batch -n errors -b batch_logs.txt" << std::endl;
             std::cout << "  Flush logs: " << argv[0] << " -c flush -d /path/to/logs" << std::endl;
+            std::cout << "  Follow log: " << argv[0] << " -c tail -n main --since 1024 --inode 5678 --follow" << std::endl;
+            std::cout << "  Search log: " << argv[0] << " -c query -n main --level 2 --from '2024-05-01 08:00' --grep timeout --limit 50" << std::endl;
+            std::cout << "  Statistics: " << argv[0] << " -c stats -j" << std::endl;
             std::cout << "  Clean logs: " << argv[0] << " -c clean -d /path/to/logs" << std::endl;
+            std::cout << "  Render log: " << argv[0] << " -c cat -n main (or -b /path/to/file.blog)" << std::endl;
+            std::cout << "  Watch file: " << argv[0] << " -c watch -n service -w /path/config.sh -m /path/reload.sh -O keys" << std::endl;
+            std::cout << "  Capture output: " << argv[0] << " -c run -n gpu-scheduler -e 'fatal|error' -- /path/gpu-scheduler --flag" << std::endl;
+            std::cout << "  Run under daemon: " << argv[0] << " -c spawn -n gpu-scheduler -m /path/gpu-scheduler" << std::endl;
             return 0;
         } else {
             std::cerr << "Error: Unknown or invalid argument: " << arg << std::endl;
@@ -633,166 +1386,557 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // 解析时间戳精度配置: "精度" 作为默认值, "名称=精度" 针对单个日志
+    TimePrecision default_precision = TIME_SECONDS;
+    std::vector<std::pair<std::string, TimePrecision>> precisions;
+    bool precision_ok = true;
+    for_each_name(precision_spec, [&](std::string_view entry) {
+        size_t eq = entry.find('=');
+        std::string value(eq == std::string_view::npos ? entry : entry.substr(eq + 1));
+        TimePrecision precision;
+        if (!parse_time_precision(value.c_str(), precision)) {
+            std::cerr << "Error: Invalid timestamp precision: " << value << std::endl;
+            precision_ok = false;
+        } else if (eq == std::string_view::npos) {
+            default_precision = precision;
+        } else {
+            precisions.emplace_back(entry.substr(0, eq), precision);
+        }
+    });
+    if (!precision_ok) {
+        return 1;
+    }
+    auto precision_for = [&](std::string_view name) {
+        for (const auto& entry : precisions) {
+            if (entry.first == name) return entry.second;
+        }
+        return default_precision;
+    };
+
+    // 解析限流配置: "[日志名][:级别]=速率[/突发]"，只有 "速率[/突发]" 时作用于所有日志
+    struct RateEntry {
+        std::string log_name;
+        int level;
+        RateLimit limit;
+    };
+    std::vector<RateEntry> rate_entries;
+    bool rate_ok = true;
+    for_each_name(rate_spec, [&](std::string_view entry) {
+        size_t eq = entry.find('=');
+        std::string_view key = eq == std::string_view::npos ? std::string_view() : entry.substr(0, eq);
+        std::string value(eq == std::string_view::npos ? entry : entry.substr(eq + 1));
+        RateEntry rate{std::string(key.substr(0, std::min(key.find(':'), key.size()))), 0, {}};
+        if (size_t colon = key.find(':'); colon != std::string_view::npos) {
+            LogLevel level;
+            if (!parse_batch_level(key.substr(colon + 1), level)) {
+                std::cerr << "Error: Invalid level in rate limit: " << entry << std::endl;
+                rate_ok = false;
+                return;
+            }
+            rate.level = level;
+        }
+        char* end = nullptr;
+        rate.limit.rate = std::strtod(value.c_str(), &end);
+        rate.limit.burst = *end == '/' ? std::strtod(end + 1, &end) : rate.limit.rate;
+        if (*end != '\0' || rate.limit.rate < 0 || (rate.limit.rate > 0 && rate.limit.burst < 1)) {
+            std::cerr << "Error: Invalid rate limit: " << entry << std::endl;
+            rate_ok = false;
+            return;
+        }
+        rate_entries.push_back(std::move(rate));
+    });
+    if (!rate_ok) {
+        return 1;
+    }
+
     // 如果没有指定命令，默认启动守护进程
     if (command.empty()) {
         command = "daemon";
     }
 
-    // 创建日志记录器
-    try {
-        if (!g_logger) {
-            g_logger = std::make_unique<Logger>(log_dir, log_level_int);
-            if (low_power) {
-                g_logger->set_low_power_mode(true);
+    // 创建日志记录器 - 客户端命令仅在守护进程不可用时才需要
+    auto init_logger = [&]() -> bool {
+        try {
+            if (!g_logger) {
+                g_logger = std::make_unique<Logger>(log_dir, log_level_int);
+                g_logger->set_overflow_policy(overflow_policy);
+                g_logger->set_log_generations(generations);
+                g_logger->set_dir_budget(dir_budget);
+                g_logger->set_time_precision({}, default_precision);
+                for (const auto& entry : precisions) {
+                    g_logger->set_time_precision(entry.first, entry.second);
+                }
+
+                // 启用内存映射日志段
+                for_each_name(mapped_names, [&](std::string_view name) {
+                    if (!g_logger->enable_mapped_log(name, segment_size ? segment_size : 102400)) {
+                        std::cerr << "Warning: Falling back to buffered writes for log: " << name << std::endl;
+                    }
+                });
+                // 启用二进制格式
+                for_each_name(binary_names, [&](std::string_view name) {
+                    g_logger->enable_binary_log(name);
+                });
+                for (const auto& entry : rate_entries) {
+                    g_logger->set_rate_limit(entry.log_name, entry.level, entry.limit);
+                }
+                g_logger->set_dedup(dedup);
+                g_logger->set_stats_interval(stats_interval);
+                if (low_power) {
+                    g_logger->set_low_power_mode(true);
+                }
+                if (follow_power) {
+                    g_logger->set_follow_power(true);
+                }
             }
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to initialize logging system: " << e.what() << std::endl;
+            return false;
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Failed to initialize logging system: " << e.what() << std::endl;
-        return 1;
-    }
+        return true;
+    };
 
     // 执行命令
     if (command == "daemon") {
+        LogServer server(socket_name);
+        if (!server.open_socket()) {
+            return 1;
+        }
+
+        // 托管动作的子进程和终止信号都经 signalfd 处理，必须在任何线程创建之前屏蔽
+        sigset_t daemon_signals;
+        sigemptyset(&daemon_signals);
+        sigaddset(&daemon_signals, SIGCHLD);
+        sigaddset(&daemon_signals, SIGTERM);
+        sigaddset(&daemon_signals, SIGINT);
+        pthread_sigmask(SIG_BLOCK, &daemon_signals, nullptr);
+
+        if (!init_logger()) {
+            return 1;
+        }
+        // 内核不支持或被 SELinux 拒绝时继续同步写入
+        if (async_io && !g_logger->enable_async_io()) {
+            std::cerr << "Warning: io_uring is unavailable, using synchronous writes" << std::endl;
+            async_io = false;
+        }
+        // 上次异常退出时未落盘的记录在接收新记录之前补写
+        if (journal_size > 0 && !g_logger->enable_journal(journal_size)) {
+            std::cerr << "Warning: Unflushed records will not survive a daemon crash" << std::endl;
+        }
+        watch_verbose = log_level_int >= LOG_DEBUG;
+        watch_log = [](bool error, const std::string& message) {
+            if (g_logger) {
+                g_logger->write_log("filewatch", error ? LOG_ERROR : LOG_DEBUG, message);
+            }
+        };
+        WatchHost watches(*g_logger);
+
         // 设置文件权限掩码
         umask(0022);
 
-        // 设置信号处理
-        signal(SIGTERM, signal_handler);
-        signal(SIGINT, signal_handler);
+        // SIGTERM 和 SIGINT 由服务主循环处理
         signal(SIGPIPE, SIG_IGN);
 
         // 写入启动日志
         std::string startup_msg = "Logging system daemon started";
-        if (low_power) {
+        if (follow_power) {
+            startup_msg += " (Following device power state)";
+        } else if (low_power) {
             startup_msg += " (Low power mode)";
         }
+        if (async_io) {
+            startup_msg += " (Asynchronous writes)";
+        }
         g_logger->write_log("system", LOG_INFO, startup_msg);
 
-        // 优化的主循环
-        std::mutex main_mutex;
-        std::condition_variable main_cv;
-        std::unique_lock<std::mutex> lock(main_mutex);
-
-        // 守护进程主循环
-        while (g_logger && g_logger->is_running()) {
-            auto wait_duration = std::chrono::hours(1);
-            main_cv.wait_for(lock, wait_duration);
+        // 守护进程主循环 - 接收客户端日志
+        bool served = server.serve(*g_logger, watches);
 
-            if (!g_logger || !g_logger->is_running()) {
-                break;
-            }
-        }
-        
         // 清理
+        watches.stop();
         if (g_logger) {
             g_logger->write_log("system", LOG_INFO, "Logging system daemon is stopping...");
             g_logger->stop();
         }
-        return 0;
+        return served ? 0 : 1;
 
     } else if (command == "write") {
         // 写入日志
         if (message.empty()) {
             std::cerr << "Error: Writing log requires message content (-m)" << std::endl;
-            if (g_logger) g_logger->stop();
             return 1;
         }
 
+        // 优先发送给守护进程
+        LogClient client(socket_name);
+        if (client.append(static_cast<char>('0' + log_level_int), log_name, message, tag) && client.send()) {
+            return 0;
+        }
+
+        // 守护进程不可用，直接写入文件
+        if (!init_logger()) {
+            return 1;
+        }
         LogLevel level = static_cast<LogLevel>(log_level_int);
-        g_logger->write_log(log_name, level, message);
+        g_logger->write_log(log_name, level, message, tag);
 
         g_logger->flush_buffer(log_name);
         g_logger->stop();
         return 0;
 
     } else if (command == "batch") {
-        // 批量写入日志
-        if (batch_file.empty()) {
-            std::cerr << "Error: Batch write requires input file (-b)" << std::endl;
-            if (g_logger) g_logger->stop();
+        // 批量写入日志：逐块读取并原地切分，内存占用与文件大小无关。
+        // -b - 或省略 -b 且标准输入不是终端时从标准输入读取
+        int batch_fd = STDIN_FILENO;
+        if (!batch_file.empty() && batch_file != "-") {
+            batch_fd = open(batch_file.c_str(), O_RDONLY | O_CLOEXEC);
+            if (batch_fd < 0) {
+                std::cerr << "Error: Cannot open batch file: " << batch_file << " (" << strerror(errno) << ")" << std::endl;
+                return 1;
+            }
+            posix_fadvise(batch_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        } else if (batch_file.empty() && isatty(STDIN_FILENO)) {
+            std::cerr << "Error: Batch write requires input file (-b) or piped input" << std::endl;
             return 1;
         }
 
-        // 读取批处理文件
-        std::ifstream batch_in(batch_file);
-        if (!batch_in.is_open()) {
-            std::cerr << "Error: Cannot open batch file: " << batch_file << " (" << strerror(errno) << ")" << std::endl;
-            if (g_logger) g_logger->stop();
-            return 1;
-        }
+        // 优先发送给守护进程；不可用时未发送的记录连同后续记录直接写入文件
+        LogClient client(socket_name);
+        bool direct = false;
+        bool failed = false;
+        auto switch_to_direct = [&]() {
+            if (!init_logger()) {
+                failed = true;
+                return;
+            }
+            direct = true;
+            client.take_pending([&](LogLevel level, std::string_view, std::string_view, std::string_view message) {
+                g_logger->write_log(log_name, level, message);
+            });
+        };
+        auto deliver = [&](LogLevel level, std::string_view message) {
+            if (!direct) {
+                char op = static_cast<char>('0' + level);
+                if (client.append(op, log_name, message)) {
+                    return;
+                }
+                if (client.send()) {
+                    client.append(op, log_name, message);
+                    return;
+                }
+                switch_to_direct();
+                if (failed) {
+                    return;
+                }
+            }
+            g_logger->write_log(log_name, level, message);
+        };
 
-        std::vector<std::pair<LogLevel, std::string>> entries;
-        std::string line;
+        LineReader reader(262144);
         int line_num = 0;
-
-        // 从文件读取日志条目
-        while (std::getline(batch_in, line)) {
+        reader.read(batch_fd, [&](std::string_view line) {
             line_num++;
             // 跳过空行和注释
-            if (line.empty() || line[0] == '#') continue;
+            if (failed || line.empty() || line[0] == '#') return;
 
             // 查找分隔符 '|'
-            size_t pos = line.find('|');
-            if (pos == std::string::npos) {
+            const char* bar = static_cast<const char*>(memchr(line.data(), '|', line.size()));
+            if (!bar) {
                 std::cerr << "Warning: Batch file line " << line_num << " format error (missing '|'): " << line << std::endl;
-                continue;
+                return;
             }
 
-            // 解析日志级别
-            std::string level_str = line.substr(0, pos);
-            // 移除可能的空格
-            level_str.erase(0, level_str.find_first_not_of(" \t"));
-            level_str.erase(level_str.find_last_not_of(" \t") + 1);
+            // 解析日志级别，移除两侧空白
+            std::string_view level_str = line.substr(0, static_cast<size_t>(bar - line.data()));
+            level_str.remove_prefix(std::min(level_str.find_first_not_of(" \t"), level_str.size()));
+            level_str.remove_suffix(level_str.size() - std::min(level_str.find_last_not_of(" \t") + 1, level_str.size()));
+            LogLevel level = LOG_INFO;
+            if (!parse_batch_level(level_str, level)) {
+                std::cerr << "Warning: Batch file line " << line_num << " unrecognized level (" << level_str << "), using INFO" << std::endl;
+            }
 
-            LogLevel level = LOG_INFO; // 默认级别
-            try {
-                int lvl_int = std::stoi(level_str);
-                if (lvl_int >= LOG_ERROR && lvl_int <= LOG_DEBUG) {
-                    level = static_cast<LogLevel>(lvl_int);
-                } else {
-                    std::cerr << "Warning: Batch file line " << line_num << " invalid level (" << level_str << "), using INFO" << std::endl;
+            // 消息内容，移除前导空白
+            std::string_view msg = line.substr(static_cast<size_t>(bar - line.data()) + 1);
+            msg.remove_prefix(std::min(msg.find_first_not_of(" \t"), msg.size()));
+            deliver(level, msg);
+        });
+        if (batch_fd != STDIN_FILENO) {
+            close(batch_fd);
+        }
+
+        if (!direct && !failed && !client.send()) {
+            switch_to_direct();
+        }
+        if (failed) {
+            return 1;
+        }
+        if (direct) {
+            g_logger->flush_buffer(log_name);
+            g_logger->stop();
+        }
+        return 0;
+
+    } else if (command == "cat") {
+        // 以文本格式输出日志，无需守护进程
+        if (!batch_file.empty()) {
+            if (!cat_log_file(batch_file, default_precision)) {
+                std::cerr << "Error: Cannot open log file: " << batch_file << " (" << strerror(errno) << ")" << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        // 从最旧的历史代到当前文件依次输出
+        std::string base_path = log_dir + "/" + log_name;
+        TimePrecision precision = precision_for(log_name);
+        bool found = false;
+        for (const char* suffix : {binlog::FILE_SUFFIX, ".log"}) {
+            std::string path = base_path + suffix;
+            found = cat_log_file(path + ".old", precision) || found;
+            for (unsigned generation = highest_generation(path); generation >= 1; --generation) {
+                found = cat_log_file(generation_path(path, generation, true), precision) || found;
+                found = cat_log_file(generation_path(path, generation, false), precision) || found;
+            }
+            found = cat_log_file(path, precision) || found;
+            if (found) {
+                break;
+            }
+        }
+        if (!found) {
+            std::cerr << "Error: No log file found for: " << log_name << std::endl;
+            return 1;
+        }
+        return 0;
+
+    } else if (command == "watch" || command == "unwatch" || command == "spawn") {
+        // 文件监控和托管命令由守护进程执行，守护进程未运行时返回失败
+        LogClient client(socket_name);
+        std::string output_log = log_name_given ? log_name : "filewatch";
+        if (command == "unwatch" || command == "spawn") {
+            bool ok = command == "unwatch" ? !watch_path.empty() && client.append('U', "", watch_path)
+                                           : !message.empty() && client.append('X', output_log, message);
+            if (!ok) {
+                std::cerr << "Error: Missing arguments for " << command << " (use -h for help)" << std::endl;
+                return 1;
+            }
+            if (!client.send()) {
+                std::cerr << "Error: Logging daemon is not running on socket: " << socket_name << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        // 收集所有注册项：路径、<path>\0<action>\0<options>
+        std::vector<std::pair<std::string, std::string>> registrations;
+        if (!batch_file.empty()) {
+            // 监控清单，每行 路径|动作|选项
+            std::ifstream list(batch_file);
+            if (!list) {
+                std::cerr << "Error: Cannot open watch list: " << batch_file << std::endl;
+                return 1;
+            }
+            std::string line;
+            while (std::getline(list, line)) {
+                line = trim(line);
+                if (line.empty() || line[0] == '#') {
+                    continue;
+                }
+                WatchSpec spec;
+                if (!parse_watch_line(line, spec)) {
+                    std::cerr << "Error: Invalid watch list entry: " << line << std::endl;
+                    return 1;
+                }
+                size_t second = line.find('|', line.find('|') + 1);
+                std::string options = second == std::string::npos ? std::string() : line.substr(second + 1);
+                std::string action = (spec.action.shell ? "-c " : "") + spec.action.command;
+                registrations.emplace_back(spec.path, spec.path + '\0' + action + '\0' + options);
+            }
+        } else {
+            WatchSpec spec;
+            if (watch_path.empty() || message.empty() || !parse_watch_options(watch_options, spec)) {
+                std::cerr << "Error: watch requires -w PATH, -m ACTION and valid -O options" << std::endl;
+                return 1;
+            }
+            registrations.emplace_back(watch_path, watch_path + '\0' + message + '\0' + watch_options);
+        }
+
+        // 逐项等待守护进程确认，任何一项失败时注销已注册的项，整体成功或整体失败
+        for (size_t i = 0; i < registrations.size(); ++i) {
+            std::string response;
+            if (client.request('W', output_log, registrations[i].second, response) && response == "OK") {
+                continue;
+            }
+            if (response.empty()) {
+                std::cerr << "Error: Logging daemon is not running on socket: " << socket_name << std::endl;
+            } else {
+                std::cerr << "Error: Daemon rejected watch " << registrations[i].first << ": " << response << std::endl;
+            }
+            for (size_t j = 0; j < i; ++j) {
+                if (!client.append('U', "", registrations[j].first)) {
+                    client.send();
+                    client.append('U', "", registrations[j].first);
                 }
-            } catch (const std::invalid_argument&) {
-                // 如果不是数字，尝试匹配字符串
-                if (level_str == "ERROR") level = LOG_ERROR;
-                else if (level_str == "WARN") level = LOG_WARN;
-                else if (level_str == "INFO") level = LOG_INFO;
-                else if (level_str == "DEBUG") level = LOG_DEBUG;
-                else {
-                    std::cerr << "Warning: Batch file line " << line_num << " unrecognized level (" << level_str << "), using INFO" << std::endl;
+            }
+            client.send();
+            return 1;
+        }
+        return 0;
+
+    } else if (command == "run") {
+        // 运行命令并持续记录输出，守护进程不可用时直接写入文件
+        if (!run_argv) {
+            std::cerr << "Error: run requires a command after --" << std::endl;
+            return 1;
+        }
+        LogClient client(socket_name);
+        bool direct = !client.append('0' + LOG_INFO, log_name, std::string("Running ") + run_argv[0], tag) ||
+                      !client.send();
+        if (direct && !init_logger()) {
+            return 1;
+        }
+        auto switch_to_direct = [&]() {
+            if (!init_logger()) {
+                return false;
+            }
+            direct = true;
+            client.take_pending([](LogLevel level, std::string_view name, std::string_view record_tag,
+                                   std::string_view message) {
+                g_logger->write_log(name, level, message, record_tag);
+            });
+            return true;
+        };
+        auto sink = [&](LogLevel level, std::string_view line) {
+            if (direct) {
+                g_logger->write_log(log_name, level, line, tag);
+                return;
+            }
+            char op = static_cast<char>('0' + level);
+            if (!client.append(op, log_name, line, tag)) {
+                // 数据报已满；守护进程中途退出时改为直接写入，未发送的记录一并写入
+                if (!client.send() && switch_to_direct()) {
+                    g_logger->write_log(log_name, level, line, tag);
+                    return;
                 }
-            } catch (const std::out_of_range&) {
-                std::cerr << "Warning: Batch file line " << line_num << " level out of range (" << level_str << "), using INFO" << std::endl;
+                client.append(op, log_name, line, tag);
             }
+        };
+        auto flush = [&]() {
+            if (!direct && !client.send()) {
+                switch_to_direct();
+            }
+        };
+        int code = run_command(run_argv, level_rules, sink, flush);
+        if (g_logger) {
+            g_logger->flush_buffer(log_name);
+            g_logger->stop();
+        }
+        return code;
+
+    } else if (command == "tail") {
+        // 增量读取文本日志，读取前请守护进程刷新该日志的缓冲区
+        LogClient client(socket_name);
+        auto request_flush = [&]() {
+            client.append('F', log_name, {});
+            if (!client.send()) {
+                client.take_pending([](LogLevel, std::string_view, std::string_view, std::string_view) {});
+            }
+        };
+        std::string path = log_dir + "/" + log_name + ".log";
+        if (!tail_log_file(path, tail_since, tail_inode, tail_max_bytes, tail_follow ? tail_timeout_ms : 0, request_flush)) {
+            std::cerr << "Error: Cannot read log file: " << path << " (" << strerror(errno) << ")" << std::endl;
+            return 1;
+        }
+        return 0;
 
-            // 获取消息内容
-            std::string msg = line.substr(pos + 1);
-            // 移除消息前导空格
-            msg.erase(0, msg.find_first_not_of(" \t"));
+    } else if (command == "query") {
+        // 查询文本日志，读取前请守护进程刷新该日志，使最新记录和索引都已落盘
+        LogClient client(socket_name);
+        client.append('F', log_name, {});
+        if (!client.send()) {
+            client.take_pending([](LogLevel, std::string_view, std::string_view, std::string_view) {});
+        }
 
-            // 添加到条目列表
-            entries.emplace_back(level, std::move(msg));
+        std::string path = log_dir + "/" + log_name + ".log";
+        std::vector<std::string> files = {path};
+        for (unsigned generation = 1, highest = highest_generation(path); generation <= highest; ++generation) {
+            for (bool compressed : {false, true}) {
+                files.push_back(generation_path(path, generation, compressed));
+            }
+        }
+        files.push_back(path + ".old");
+
+        // 从最新的一代向前查询，凑够 limit 行后不再读取更旧的历史代
+        std::vector<std::vector<std::string>> results;
+        size_t total = 0;
+        bool found = false;
+        for (const auto& file : files) {
+            if (query.limit > 0 && total >= query.limit) {
+                break;
+            }
+            std::vector<std::string> lines;
+            if (!query_log_file(file, query, lines)) {
+                continue;
+            }
+            found = true;
+            if (query.limit > 0 && lines.size() > query.limit - total) {
+                lines.erase(lines.begin(), lines.end() - static_cast<std::ptrdiff_t>(query.limit - total));
+            }
+            total += lines.size();
+            results.push_back(std::move(lines));
+        }
+        if (!found) {
+            if (access((log_dir + "/" + log_name + binlog::FILE_SUFFIX).c_str(), F_OK) == 0) {
+                std::cerr << "Error: Query supports text logs only, use -c cat for binary log: " << log_name << std::endl;
+            } else {
+                std::cerr << "Error: No log file found for: " << log_name << std::endl;
+            }
+            return 1;
         }
 
-        batch_in.close();
+        std::string output;
+        for (auto it = results.rbegin(); it != results.rend(); ++it) {
+            for (const auto& line : *it) {
+                output += line;
+                output += '\n';
+            }
+            write_stdout(output);
+            output.clear();
+        }
+        return 0;
 
-        // 批量写入日志
-        if (!entries.empty()) {
-            g_logger->batch_write(log_name, entries);
-            // 批量写入后立即刷新
-            g_logger->flush_buffer(log_name);
+    } else if (command == "stats") {
+        // 运行统计只存在于守护进程中
+        LogClient client(socket_name);
+        std::string response;
+        if (!client.request('S', json_output ? "json" : "text", response)) {
+            std::cerr << "Error: Logging daemon is not running on socket: " << socket_name << std::endl;
+            return 1;
         }
-        g_logger->stop();
+        write_stdout(response);
         return 0;
 
     } else if (command == "flush") {
         // 刷新日志
+        LogClient client(socket_name);
+        if (client.append('F', "", "") && client.send()) {
+            return 0;
+        }
+        if (!init_logger()) {
+            return 1;
+        }
         g_logger->flush_all();
         g_logger->stop();
         return 0;
 
     } else if (command == "clean") {
-        // 清理日志
+        // 清理日志 - 守护进程运行时由其关闭文件后删除
+        LogClient client(socket_name);
+        if (client.append('C', "", "") && client.send()) {
+            return 0;
+        }
+        if (!init_logger()) {
+            return 1;
+        }
         g_logger->clean_logs();
         g_logger->stop();
         return 0;
@@ -800,7 +1944,6 @@ int main(int argc, char* argv[]) {
     } else {
         std::cerr << "Error: Unknown command '" << command << "'" << std::endl;
         std::cerr << "Use -h for help." << std::endl;
-        if (g_logger) g_logger->stop();
         return 1;
     }
 
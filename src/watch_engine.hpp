@@ -0,0 +1,1265 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string_view>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <spawn.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/auxv.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <asm/hwcap.h>
+#endif
+
+// 文件监控引擎：inotify 监控、事件防抖、内容比较和异步动作执行。
+// filewatch 独立运行时使用，logmonitor 守护进程也在其中托管监控项
+
+extern char** environ;
+
+#define EVENT_SIZE (sizeof(struct inotify_event))
+#define BUF_LEN (512 * (EVENT_SIZE + 16))  // 减小缓冲区大小以节省内存
+
+// 文件被写入、替换或新建
+static constexpr uint32_t CHANGE_EVENTS = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+// 目录中的条目被删除或移走（只对目录监控项有意义）
+static constexpr uint32_t REMOVE_EVENTS = IN_DELETE | IN_MOVED_FROM;
+// 只监控目录：单个文件通过其所在目录监控，原子替换(rename)后监控不会失效
+static constexpr uint32_t WATCH_MASK = CHANGE_EVENTS | REMOVE_EVENTS | IN_DELETE_SELF | IN_MOVE_SELF |
+                                       IN_ONLYDIR | IN_DONT_FOLLOW;
+
+// 动作仍在运行时再次触发的处理方式
+enum ActionPolicy {
+    POLICY_DEFAULT = -1,  // 使用 -P 给出的全局策略
+    POLICY_QUEUE = 0,     // 等上一次结束后再执行
+    POLICY_CANCEL = 1     // 终止上一次，立即重新执行
+};
+
+inline void write_str(int out, const std::string& text) {
+    write(out, text.data(), text.size());
+}
+
+// 诊断输出：默认写到标准错误，宿主进程可以改为写入日志
+inline bool watch_verbose = false;
+inline void (*watch_log)(bool error, const std::string& message) = [](bool, const std::string& message) {
+    write_str(STDERR_FILENO, "filewatch: " + message + "\n");
+};
+
+inline void log_verbose(const std::string& message) {
+    if (watch_verbose) {
+        watch_log(false, message);
+    }
+}
+
+// 触发时执行的动作：脚本路径或shell命令
+struct Action {
+    std::string command;
+    bool shell = false;
+    ActionPolicy policy = POLICY_DEFAULT;
+    int timeout = -1;  // 秒，0 表示不限制，-1 使用全局设置
+    std::string log_name;  // 非空时捕获标准输出/错误，按行交给执行器的输出回调
+};
+
+[[nodiscard]] inline bool parse_policy(const char* name, ActionPolicy& policy) {
+    if (strcmp(name, "queue") == 0) {
+        policy = POLICY_QUEUE;
+    } else if (strcmp(name, "cancel") == 0) {
+        policy = POLICY_CANCEL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 一个监控项：文件或目录，各自拥有动作和过滤规则
+struct WatchSpec {
+    std::string path;
+    Action action;
+    bool recursive = false;
+    bool hash = false;   // 内容未变时不触发
+    bool keys = false;   // 比较 KEY=value 配置项，通过环境变量传出变化的键
+    std::vector<std::string> includes;
+    std::vector<std::string> excludes;
+
+    // 运行时状态
+    bool is_dir = false;
+    std::string dir;     // 实际监控的目录：目录本身或文件所在目录
+    std::string name;    // 监控单个文件时的文件名
+    int root_wd = -1;    // -1 表示尚未挂载或已失效，等待重新挂载
+    bool removed = false;  // 已注销，保留位置使其他监控项的下标不变
+
+    // 不含 '/' 的模式只匹配文件名，否则匹配相对于监控目录的路径
+    static bool glob_match(const std::string& pattern, const std::string& relative) {
+        const char* subject = relative.c_str();
+        if (pattern.find('/') == std::string::npos) {
+            size_t slash = relative.rfind('/');
+            if (slash != std::string::npos) {
+                subject += slash + 1;
+            }
+        }
+        return fnmatch(pattern.c_str(), subject, 0) == 0;
+    }
+
+    bool excluded(const std::string& relative) const {
+        for (const auto& pattern : excludes) {
+            if (glob_match(pattern, relative)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool matches(const std::string& relative) const {
+        if (excluded(relative)) {
+            return false;
+        }
+        if (includes.empty()) {
+            return true;
+        }
+        for (const auto& pattern : includes) {
+            if (glob_match(pattern, relative)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// 一次事件：监控项及发生变化的路径
+struct Trigger {
+    size_t spec;
+    std::string path;
+};
+
+// inotify 监控引擎：多个监控项共用一个 inotify 实例，
+// 目录递归监控并自动加入新建子目录，根目录失效后自动重新挂载
+class WatchEngine {
+public:
+    explicit WatchEngine(std::vector<WatchSpec> specs) : specs(std::move(specs)) {}
+
+    ~WatchEngine() {
+        if (inotify_fd >= 0) {
+            close(inotify_fd);
+        }
+    }
+
+    WatchEngine(const WatchEngine&) = delete;
+    WatchEngine& operator=(const WatchEngine&) = delete;
+
+    bool open() {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        return inotify_fd >= 0;
+    }
+
+    int fd() const { return inotify_fd; }
+
+    const std::vector<WatchSpec>& watch_specs() const { return specs; }
+
+    size_t armed_count() const {
+        return std::count_if(specs.begin(), specs.end(), [](const WatchSpec& s) { return s.root_wd >= 0; });
+    }
+
+    bool has_pending() const {
+        return std::any_of(specs.begin(), specs.end(), [](const WatchSpec& s) { return !s.removed && s.root_wd < 0; });
+    }
+
+    // 运行中加入监控项，返回其下标
+    size_t add_spec(WatchSpec spec) {
+        specs.push_back(std::move(spec));
+        arm(specs.size() - 1);
+        return specs.size() - 1;
+    }
+
+    // 注销监控项，不再被其他监控项使用的目录同时移除监控
+    void remove_spec(size_t index) {
+        specs[index].removed = true;
+        specs[index].root_wd = -1;
+        for (auto it = nodes.begin(); it != nodes.end();) {
+            auto& users = it->second.specs;
+            users.erase(std::remove(users.begin(), users.end(), index), users.end());
+            if (users.empty()) {
+                inotify_rm_watch(inotify_fd, it->first);
+                it = nodes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // 挂载所有未挂载的监控项；重新挂载成功视为一次变化
+    void arm_pending(std::vector<Trigger>& triggers, bool initial) {
+        for (size_t i = 0; i < specs.size(); ++i) {
+            if (!specs[i].removed && specs[i].root_wd < 0 && arm(i) && !initial) {
+                add_trigger(triggers, i, specs[i].path);
+            }
+        }
+    }
+
+    // 读取并处理所有已到达的事件，合并交给 Debouncer
+    bool read_events(std::vector<Trigger>& triggers) {
+        char buffer[BUF_LEN] __attribute__((aligned(8)));  // 内存对齐优化
+        while (true) {
+            ssize_t length = read(inotify_fd, buffer, BUF_LEN);
+            if (length < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            if (length == 0) {
+                return true;
+            }
+            for (ssize_t i = 0; i < length;) {
+                const auto* event = reinterpret_cast<const struct inotify_event*>(&buffer[i]);
+                handle_event(*event, triggers);
+                i += EVENT_SIZE + event->len;
+            }
+        }
+    }
+
+private:
+    struct WatchNode {
+        std::string path;
+        dev_t dev = 0;
+        ino_t ino = 0;
+        std::vector<size_t> specs;  // 关联的监控项
+    };
+
+    static std::string join_path(const std::string& dir, const char* name) {
+        return dir == "/" ? dir + name : dir + '/' + name;
+    }
+
+    static std::string relative_path(const WatchSpec& spec, const std::string& full) {
+        return full.size() > spec.dir.size() ? full.substr(spec.dir.size() + (spec.dir == "/" ? 0 : 1)) : std::string();
+    }
+
+    static void add_trigger(std::vector<Trigger>& triggers, size_t spec, const std::string& path) {
+        // 同一路径的连续事件（IN_MODIFY 后紧跟 IN_CLOSE_WRITE）只记录一次
+        if (!triggers.empty() && triggers.back().spec == spec && triggers.back().path == path) return;
+        triggers.push_back({spec, path});
+    }
+
+    bool arm(size_t index) {
+        WatchSpec& spec = specs[index];
+        struct stat st;
+        spec.is_dir = stat(spec.path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        if (spec.is_dir) {
+            spec.dir = spec.path;
+            spec.name.clear();
+        } else {
+            size_t slash = spec.path.rfind('/');
+            if (slash == std::string::npos) {
+                spec.dir = ".";
+                spec.name = spec.path;
+            } else {
+                spec.dir = slash == 0 ? "/" : spec.path.substr(0, slash);
+                spec.name = spec.path.substr(slash + 1);
+            }
+        }
+
+        int wd = add_watch(spec.dir, index);
+        if (wd < 0) {
+            return false;
+        }
+        spec.root_wd = wd;
+        if (spec.is_dir && spec.recursive) {
+            add_subdirectories(spec.dir, index);
+        }
+        log_verbose("watching " + spec.path);
+        return true;
+    }
+
+    int add_watch(const std::string& path, size_t spec) {
+        int wd = inotify_add_watch(inotify_fd, path.c_str(), WATCH_MASK);
+        if (wd < 0) {
+            log_verbose("cannot watch " + path + ": " + strerror(errno));
+            return -1;
+        }
+        // 同一目录经由新路径加入时返回相同的 wd，更新路径
+        WatchNode& node = nodes[wd];
+        node.path = path;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0) {
+            node.dev = st.st_dev;
+            node.ino = st.st_ino;
+        }
+        if (std::find(node.specs.begin(), node.specs.end(), spec) == node.specs.end()) {
+            node.specs.push_back(spec);
+        }
+        return wd;
+    }
+
+    // 迭代遍历子目录，避免深层目录导致栈溢出
+    void add_subdirectories(const std::string& root, size_t spec) {
+        std::vector<std::string> pending{root};
+        while (!pending.empty()) {
+            std::string dir = std::move(pending.back());
+            pending.pop_back();
+            DIR* handle = opendir(dir.c_str());
+            if (!handle) continue;
+            while (struct dirent* entry = readdir(handle)) {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+                std::string child = join_path(dir, entry->d_name);
+                bool is_dir = entry->d_type == DT_DIR;
+                if (entry->d_type == DT_UNKNOWN) {
+                    struct stat st;
+                    is_dir = lstat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+                }
+                if (!is_dir || specs[spec].excluded(relative_path(specs[spec], child))) continue;
+                if (add_watch(child, spec) >= 0) {
+                    pending.push_back(std::move(child));
+                }
+            }
+            closedir(handle);
+        }
+    }
+
+    void remove_node(int wd) {
+        auto it = nodes.find(wd);
+        if (it == nodes.end()) return;
+        for (size_t index : it->second.specs) {
+            if (specs[index].root_wd == wd) {
+                specs[index].root_wd = -1;
+                log_verbose("lost watch on " + specs[index].path + ", will re-arm");
+            }
+        }
+        nodes.erase(it);
+    }
+
+    void handle_event(const struct inotify_event& event, std::vector<Trigger>& triggers) {
+        // 队列溢出时事件已丢失，所有监控项都视为发生变化
+        if (event.mask & IN_Q_OVERFLOW) {
+            for (size_t i = 0; i < specs.size(); ++i) {
+                if (specs[i].root_wd >= 0) add_trigger(triggers, i, specs[i].path);
+            }
+            return;
+        }
+
+        auto it = nodes.find(event.wd);
+        if (it == nodes.end()) return;
+
+        if (event.mask & IN_IGNORED) {
+            remove_node(event.wd);
+            return;
+        }
+        if (event.mask & IN_MOVE_SELF) {
+            // 目录被移走：若路径已指向其他目录则放弃此监控，等待重新挂载
+            struct stat st;
+            if (stat(it->second.path.c_str(), &st) != 0 || st.st_dev != it->second.dev ||
+                st.st_ino != it->second.ino) {
+                inotify_rm_watch(inotify_fd, event.wd);
+            }
+            return;
+        }
+        if ((event.mask & IN_DELETE_SELF) || event.len == 0) {
+            // IN_DELETE_SELF 之后内核会发送 IN_IGNORED
+            return;
+        }
+
+        const std::string full = join_path(it->second.path, event.name);
+        const bool child_is_dir = event.mask & IN_ISDIR;
+        // 拷贝一份：加入新目录可能导致 nodes 重新散列
+        const std::vector<size_t> node_specs = it->second.specs;
+
+        for (size_t index : node_specs) {
+            const WatchSpec& spec = specs[index];
+            if (!spec.is_dir) {
+                if (event.name == spec.name && (event.mask & CHANGE_EVENTS)) {
+                    add_trigger(triggers, index, full);
+                }
+                continue;
+            }
+
+            const std::string relative = relative_path(spec, full);
+            if (child_is_dir && spec.recursive && (event.mask & (IN_CREATE | IN_MOVED_TO)) &&
+                !spec.excluded(relative)) {
+                // 新建或移入的子目录加入监控，其中已有的内容由本次触发覆盖
+                if (add_watch(full, index) >= 0) {
+                    add_subdirectories(full, index);
+                }
+            }
+            if ((event.mask & (CHANGE_EVENTS | REMOVE_EVENTS)) && spec.matches(relative)) {
+                add_trigger(triggers, index, full);
+            }
+        }
+    }
+
+    std::vector<WatchSpec> specs;
+    std::unordered_map<int, WatchNode> nodes;
+    int inotify_fd = -1;
+};
+
+// 变化合并后的一次执行：监控项及期间变化的全部路径
+struct Batch {
+    size_t spec;
+    std::vector<std::string> paths;
+    bool truncated;
+    std::chrono::steady_clock::time_point first_event;  // 用于统计触发延迟
+    std::vector<std::string> env;  // 额外的 NAME=value 环境变量
+};
+
+// 事件防抖：每个监控项在安静窗口内没有新事件时触发一次，
+// 事件持续不断时最迟在 max_latency 后触发。所有监控项共用一个 timerfd，
+// 只在最早的截止时间提前时才重设定时器，延后的截止时间在定时器到期时再处理
+class Debouncer {
+public:
+    using Clock = std::chrono::steady_clock;  // 与 timerfd 的 CLOCK_MONOTONIC 一致
+
+    static constexpr size_t MAX_BATCH_PATHS = 256;
+
+    Debouncer(std::chrono::milliseconds quiet, std::chrono::milliseconds max_latency)
+        : quiet(quiet), max_latency(std::max(quiet, max_latency)) {}
+
+    ~Debouncer() {
+        if (timer_fd >= 0) {
+            close(timer_fd);
+        }
+    }
+
+    Debouncer(const Debouncer&) = delete;
+    Debouncer& operator=(const Debouncer&) = delete;
+
+    bool open() {
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        return timer_fd >= 0;
+    }
+
+    int fd() const { return timer_fd; }
+
+    void add(const std::vector<Trigger>& triggers, Clock::time_point now) {
+        for (const auto& trigger : triggers) {
+            Pending& entry = pending[trigger.spec];
+            if (entry.paths.empty() && !entry.truncated) {
+                entry.first = now;
+            }
+            entry.last = now;
+            if (entry.seen.count(trigger.path) == 0) {
+                if (entry.paths.size() < MAX_BATCH_PATHS) {
+                    entry.seen.insert(trigger.path);
+                    entry.paths.push_back(trigger.path);
+                } else {
+                    entry.truncated = true;
+                }
+            }
+        }
+        schedule();
+    }
+
+    // 定时器到期：取出已到截止时间的监控项
+    void collect_due(std::vector<Batch>& due, Clock::time_point now) {
+        uint64_t expirations;
+        while (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {}
+        armed = false;
+
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (deadline(it->second) <= now) {
+                due.push_back({it->first, std::move(it->second.paths), it->second.truncated, it->second.first, {}});
+                it = pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        schedule();
+    }
+
+private:
+    struct Pending {
+        Clock::time_point first;
+        Clock::time_point last;
+        std::vector<std::string> paths;        // 按首次出现的顺序
+        std::unordered_set<std::string> seen;
+        bool truncated = false;
+    };
+
+    Clock::time_point deadline(const Pending& entry) const {
+        return std::min(entry.last + quiet, entry.first + max_latency);
+    }
+
+    void schedule() {
+        if (pending.empty()) return;
+        Clock::time_point earliest = Clock::time_point::max();
+        for (const auto& item : pending) {
+            earliest = std::min(earliest, deadline(item.second));
+        }
+        if (armed && armed_deadline <= earliest) return;
+
+        auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(earliest.time_since_epoch()).count();
+        struct itimerspec spec {};
+        spec.it_value.tv_sec = since_epoch / 1000000000;
+        spec.it_value.tv_nsec = since_epoch % 1000000000;
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            spec.it_value.tv_nsec = 1;  // 全零会关闭定时器
+        }
+        if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0) {
+            armed = true;
+            armed_deadline = earliest;
+        }
+    }
+
+    std::chrono::milliseconds quiet;
+    std::chrono::milliseconds max_latency;
+    std::unordered_map<size_t, Pending> pending;
+    int timer_fd = -1;
+    bool armed = false;
+    Clock::time_point armed_deadline;
+};
+
+// CRC32C (Castagnoli)：x86 上使用 SSE4.2 crc32 指令，ARMv8 上使用 CRC32 扩展，
+// 运行时检测 CPU 支持，不支持时回退到查表实现
+namespace crc32c {
+
+using Function = uint32_t (*)(uint32_t, const unsigned char*, size_t);
+
+inline uint32_t software(uint32_t crc, const unsigned char* data, size_t size) {
+    static const auto table = [] {
+        struct Table { uint32_t entries[256]; } result{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value >> 1) ^ (0x82F63B78u & (0u - (value & 1u)));
+            }
+            result.entries[i] = value;
+        }
+        return result;
+    }();
+    while (size--) {
+        crc = table.entries[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) inline uint32_t hardware(uint32_t crc, const unsigned char* data, size_t size) {
+    uint64_t wide = crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        wide = __builtin_ia32_crc32di(wide, word);
+    }
+    crc = static_cast<uint32_t>(wide);
+    while (size--) {
+        crc = __builtin_ia32_crc32qi(crc, *data++);
+    }
+    return crc;
+}
+
+inline bool hardware_supported() {
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+}
+#elif defined(__aarch64__)
+__attribute__((target("crc"))) inline uint32_t hardware(uint32_t crc, const unsigned char* data, size_t size) {
+    for (; size >= 8; size -= 8, data += 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    while (size--) {
+        crc = __crc32cb(crc, *data++);
+    }
+    return crc;
+}
+
+inline bool hardware_supported() {
+    return getauxval(AT_HWCAP) & HWCAP_CRC32;
+}
+#endif
+
+inline uint32_t compute(uint32_t crc, const void* data, size_t size) {
+    static const Function function = [] {
+#if defined(__x86_64__) || defined(__aarch64__)
+        if (hardware_supported()) return static_cast<Function>(hardware);
+#endif
+        return static_cast<Function>(software);
+    }();
+    return ~function(~crc, static_cast<const unsigned char*>(data), size);
+}
+
+} // namespace crc32c
+
+// 内容变化检测：记录每个路径的长度和 CRC32C，内容相同的触发被丢弃。
+// 文件用 pread 读入复用的缓冲区；keys 模式下额外解析 KEY=value 行，
+// 以 FILEWATCH_CHANGED_KEYS（空格分隔）和 FILEWATCH_OLD_<KEY>（旧值）传给动作
+class ContentTracker {
+public:
+    static constexpr size_t READ_CHUNK = 64 * 1024;
+    static constexpr size_t MAX_KEYS_FILE = 1024 * 1024;  // 超过此大小不解析配置项
+
+    // 记录初始内容，之后的比较以此为基准
+    void prime(const std::string& path, bool keys) {
+        Snapshot snapshot;
+        if (read_snapshot(path, keys, snapshot)) {
+            snapshots[path] = std::move(snapshot);
+        }
+    }
+
+    // 过滤掉内容未变的路径，返回是否还有需要触发的路径
+    bool filter(const WatchSpec& spec, Batch& batch) {
+        std::vector<std::string> kept;
+        std::map<std::string, std::string> old_values;  // 变化的键 -> 旧值（新增的键没有旧值）
+        std::vector<std::string> changed_keys;
+
+        for (auto& path : batch.paths) {
+            Snapshot current;
+            if (!read_snapshot(path, spec.keys, current)) {
+                kept.push_back(std::move(path));  // 目录等无法比较的条目照常触发
+                continue;
+            }
+            auto it = snapshots.find(path);
+            if (it != snapshots.end() && it->second.same_content(current)) {
+                continue;
+            }
+            if (spec.keys && it != snapshots.end()) {
+                diff_keys(it->second.values, current.values, changed_keys, old_values);
+            }
+            if (current.exists) {
+                snapshots[path] = std::move(current);
+            } else if (it != snapshots.end()) {
+                snapshots.erase(it);
+            }
+            kept.push_back(std::move(path));
+        }
+
+        batch.paths = std::move(kept);
+        if (!changed_keys.empty()) {
+            std::string joined;
+            for (const auto& key : changed_keys) {
+                if (!joined.empty()) joined += ' ';
+                joined += key;
+            }
+            batch.env.push_back("FILEWATCH_CHANGED_KEYS=" + joined);
+            for (const auto& item : old_values) {
+                batch.env.push_back("FILEWATCH_OLD_" + item.first + "=" + item.second);
+            }
+        }
+        return !batch.paths.empty();
+    }
+
+private:
+    struct Snapshot {
+        bool exists = false;
+        uint64_t size = 0;
+        uint32_t crc = 0;
+        std::map<std::string, std::string> values;
+
+        bool same_content(const Snapshot& other) const {
+            return exists == other.exists && size == other.size && crc == other.crc;
+        }
+    };
+
+    // 读取文件摘要；不是普通文件时返回 false，文件不存在视为一种内容状态
+    bool read_snapshot(const std::string& path, bool keys, Snapshot& snapshot) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0) {
+            return errno == ENOENT;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            close(fd);
+            return false;
+        }
+
+        bool parse = keys && static_cast<uint64_t>(st.st_size) <= MAX_KEYS_FILE;
+        content.clear();
+        buffer.resize(READ_CHUNK);
+        uint32_t crc = 0;
+        uint64_t size = 0;
+        while (true) {
+            ssize_t n = pread(fd, buffer.data(), buffer.size(), static_cast<off_t>(size));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                close(fd);
+                return false;
+            }
+            if (n == 0) break;
+            crc = crc32c::compute(crc, buffer.data(), static_cast<size_t>(n));
+            if (parse) content.append(buffer.data(), static_cast<size_t>(n));
+            size += static_cast<uint64_t>(n);
+        }
+        close(fd);
+
+        snapshot.exists = true;
+        snapshot.size = size;
+        snapshot.crc = crc;
+        if (parse) {
+            parse_values(content, snapshot.values);
+        }
+        return true;
+    }
+
+    // 解析 shell 配置中的 KEY=value 行，值按原文比较
+    static void parse_values(const std::string& text, std::map<std::string, std::string>& values) {
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = text.find('\n', pos);
+            if (end == std::string::npos) end = text.size();
+            size_t begin = text.find_first_not_of(" \t", pos);
+            if (begin < end && text.compare(begin, 7, "export ") == 0) {
+                begin = text.find_first_not_of(" \t", begin + 7);
+            }
+            size_t key_end = begin;
+            while (key_end < end && (isalnum(static_cast<unsigned char>(text[key_end])) || text[key_end] == '_')) {
+                ++key_end;
+            }
+            if (begin < end && key_end > begin && key_end < end && text[key_end] == '=' &&
+                !isdigit(static_cast<unsigned char>(text[begin]))) {
+                size_t value_end = end;
+                while (value_end > key_end + 1 && (text[value_end - 1] == '\r' || text[value_end - 1] == ' ' ||
+                                                   text[value_end - 1] == '\t')) {
+                    --value_end;
+                }
+                values[text.substr(begin, key_end - begin)] = text.substr(key_end + 1, value_end - key_end - 1);
+            }
+            pos = end + 1;
+        }
+    }
+
+    static void diff_keys(const std::map<std::string, std::string>& before,
+                          const std::map<std::string, std::string>& after,
+                          std::vector<std::string>& changed_keys,
+                          std::map<std::string, std::string>& old_values) {
+        auto note = [&](const std::string& key) {
+            if (std::find(changed_keys.begin(), changed_keys.end(), key) == changed_keys.end()) {
+                changed_keys.push_back(key);
+            }
+        };
+        for (const auto& item : before) {
+            auto it = after.find(item.first);
+            if (it == after.end() || it->second != item.second) {
+                note(item.first);
+                old_values.emplace(item.first, item.second);
+            }
+        }
+        for (const auto& item : after) {
+            if (before.find(item.first) == before.end()) {
+                note(item.first);
+            }
+        }
+    }
+
+    std::unordered_map<std::string, Snapshot> snapshots;
+    std::vector<char> buffer;  // 复用的读缓冲区
+    std::string content;
+};
+
+// 事件到动作启动的延迟直方图，按 2 的幂毫秒分桶。
+// 事件时间取自读出 inotify 事件的时刻，因此包含防抖窗口和排队等待
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKETS = 18;  // <1ms, [1,2), [2,4) ... >=65536ms
+
+    void record(std::chrono::steady_clock::duration latency) {
+        int64_t us = std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count(), 0);
+        uint64_t ms = static_cast<uint64_t>(us) / 1000;
+        size_t bucket = 0;
+        while (bucket + 1 < BUCKETS && (1ULL << bucket) <= ms) {
+            ++bucket;
+        }
+        ++counts[bucket];
+        ++total;
+        sum_us += us;
+        max_us = std::max(max_us, us);
+    }
+
+    void dump(int out) const {
+        std::string text = "filewatch: action latency (event -> start): " + std::to_string(total) + " samples";
+        if (total > 0) {
+            text += ", avg " + std::to_string(sum_us / static_cast<int64_t>(total) / 1000) + " ms, max " +
+                    std::to_string(max_us / 1000) + " ms";
+        }
+        text += "\n";
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            if (counts[i] == 0) continue;
+            if (i == 0) {
+                text += "  <1 ms";
+            } else if (i + 1 == BUCKETS) {
+                text += "  >=" + std::to_string(1ULL << (i - 1)) + " ms";
+            } else {
+                text += "  " + std::to_string(1ULL << (i - 1)) + "-" + std::to_string(1ULL << i) + " ms";
+            }
+            text += ": " + std::to_string(counts[i]) + "\n";
+        }
+        write_str(out, text);
+    }
+
+private:
+    uint64_t counts[BUCKETS] = {};
+    uint64_t total = 0;
+    int64_t sum_us = 0;
+    int64_t max_us = 0;
+};
+
+// 扩大管道容量，子进程突发输出时不必等待读端；内核拒绝时逐级减半，最终保持默认大小
+inline void grow_pipe(int fd, int size = 1 << 20) {
+    while (size > 65536 && fcntl(fd, F_SETPIPE_SZ, size) < 0) {
+        size >>= 1;
+    }
+}
+
+// 按行读取非阻塞管道：在固定缓冲区内用 memchr 切分，行以 string_view 交给回调，
+// 不为每行分配内存。超过缓冲区的长行分段交出，不截断
+class LineReader {
+public:
+    explicit LineReader(size_t capacity = 65536) : buffer(capacity) {}
+
+    // 读到 EAGAIN 为止；返回 false 表示对端已关闭，剩余的不完整行已交出
+    template <typename Callback>
+    bool read(int fd, Callback&& on_line) {
+        while (true) {
+            ssize_t n = ::read(fd, buffer.data() + used, buffer.size() - used);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            if (n == 0) {
+                if (used > 0) {
+                    on_line(std::string_view(buffer.data(), used));
+                    used = 0;
+                }
+                return false;
+            }
+            used += static_cast<size_t>(n);
+
+            const char* begin = buffer.data();
+            const char* end = begin + used;
+            const char* line = begin;
+            while (const char* newline = static_cast<const char*>(memchr(line, '\n', end - line))) {
+                on_line(std::string_view(line, newline - line));
+                line = newline + 1;
+            }
+            if (line == begin && used == buffer.size()) {
+                on_line(std::string_view(begin, used));
+                used = 0;
+            } else {
+                used = static_cast<size_t>(end - line);
+                memmove(buffer.data(), line, used);
+            }
+        }
+    }
+
+private:
+    std::vector<char> buffer;
+    size_t used{0};
+};
+
+// 动作执行器：posix_spawn 启动子进程，不阻塞监控循环。
+// 子进程由主循环收到 SIGCHLD（signalfd）后回收，超时由 timerfd 驱动。
+// 每个动作在独立进程组中运行，终止时连同其子进程一起结束。
+// 设置了 log_name 的动作，其标准输出/错误经管道按行交给输出回调
+class Executor {
+public:
+    using Clock = std::chrono::steady_clock;
+    // 参数：日志名、来源（STDOUT_FILENO / STDERR_FILENO）、一行内容（不含换行）
+    using OutputSink = std::function<void(const std::string&, int, std::string_view)>;
+
+    static constexpr std::chrono::seconds KILL_GRACE{3};  // SIGTERM 后等待多久再 SIGKILL
+    static constexpr size_t MAX_LINE = 65536;               // 超长的行分段输出
+
+    explicit Executor(size_t max_running) : max_running(std::max<size_t>(max_running, 1)) {}
+
+    ~Executor() {
+        for (auto& pipe : pipes) close(pipe.fd);
+        if (timer_fd >= 0) close(timer_fd);
+        if (output_epoll >= 0) close(output_epoll);
+    }
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    bool open() {
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        output_epoll = epoll_create1(EPOLL_CLOEXEC);
+        return timer_fd >= 0 && output_epoll >= 0;
+    }
+
+    int deadline_fd() const { return timer_fd; }
+
+    // 所有输出管道汇聚在一个内部 epoll 上，宿主只需监听这一个 fd
+    int output_fd() const { return output_epoll; }
+
+    void set_output_sink(OutputSink sink) { output_sink = std::move(sink); }
+
+    // 读取可读的输出管道，对端关闭时输出剩余内容并关闭
+    void drain_output() {
+        struct epoll_event events[8];
+        int count;
+        while ((count = epoll_wait(output_epoll, events, 8, 0)) > 0) {
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.fd;
+                auto pipe = std::find_if(pipes.begin(), pipes.end(), [fd](const OutputPipe& p) { return p.fd == fd; });
+                if (pipe != pipes.end() && !read_pipe(*pipe)) {
+                    close(pipe->fd);  // 关闭后自动从 epoll 中移除
+                    pipes.erase(pipe);
+                }
+            }
+        }
+    }
+
+    const LatencyHistogram& latency() const { return histogram; }
+
+    void submit(size_t spec, const Action& action, Batch batch) {
+        // 同一监控项的待执行批次合并，避免积压
+        auto queued = std::find_if(queue.begin(), queue.end(), [spec](const Request& r) { return r.spec == spec; });
+        if (queued != queue.end()) {
+            merge(queued->batch, batch);
+        } else {
+            queue.push_back({spec, action, std::move(batch)});
+        }
+        if (action.policy == POLICY_CANCEL) {
+            for (auto& job : jobs) {
+                if (job.spec == spec) terminate(job, Clock::now());
+            }
+        }
+        dispatch();
+    }
+
+    // 收到 SIGCHLD：回收本执行器已退出的子进程。
+    // 只等待自己的 pid，同一进程中的多个执行器互不干扰
+    void reap() {
+        for (auto job = jobs.begin(); job != jobs.end();) {
+            int status;
+            pid_t pid = waitpid(job->pid, &status, WNOHANG);
+            if (pid <= 0) {
+                ++job;
+                continue;
+            }
+            if (WIFSIGNALED(status)) {
+                log_verbose("action " + std::to_string(pid) + " killed by signal " + std::to_string(WTERMSIG(status)));
+            } else {
+                log_verbose("action " + std::to_string(pid) + " exited with " + std::to_string(WEXITSTATUS(status)));
+            }
+            job = jobs.erase(job);
+        }
+        dispatch();
+    }
+
+    // timerfd 到期：终止超时的动作
+    void expire() {
+        uint64_t expirations;
+        while (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {}
+        Clock::time_point now = Clock::now();
+        for (auto& job : jobs) {
+            if (job.deadline <= now) {
+                if (job.terminating) {
+                    kill(-job.pid, SIGKILL);
+                    job.deadline = Clock::time_point::max();
+                } else {
+                    log_verbose("action " + std::to_string(job.pid) + " timed out");
+                    terminate(job, now);
+                }
+            }
+        }
+        schedule();
+    }
+
+private:
+    struct Request {
+        size_t spec;
+        Action action;  // 拷贝一份，宿主可以在排队期间增删监控项
+        Batch batch;
+    };
+
+    struct OutputPipe {
+        int fd;
+        int stream;
+        std::string log_name;
+        LineReader reader;
+    };
+
+    // 返回 false 表示管道已关闭
+    bool read_pipe(OutputPipe& pipe) {
+        return pipe.reader.read(pipe.fd, [&](std::string_view line) {
+            output_sink(pipe.log_name, pipe.stream, line);
+        });
+    }
+
+    struct Job {
+        pid_t pid;
+        size_t spec;
+        Clock::time_point deadline;  // 超时或 SIGKILL 的截止时间
+        bool terminating;
+    };
+
+    static void merge(Batch& into, Batch& from) {
+        for (auto& path : from.paths) {
+            if (std::find(into.paths.begin(), into.paths.end(), path) != into.paths.end()) continue;
+            if (into.paths.size() < Debouncer::MAX_BATCH_PATHS) {
+                into.paths.push_back(std::move(path));
+            } else {
+                into.truncated = true;
+            }
+        }
+        into.truncated = into.truncated || from.truncated;
+        into.first_event = std::min(into.first_event, from.first_event);
+        // 合并额外环境变量：变化的键取并集，旧值保留最早的一次
+        for (auto& entry : from.env) {
+            size_t name_end = entry.find('=');
+            auto existing = std::find_if(into.env.begin(), into.env.end(), [&](const std::string& e) {
+                return e.compare(0, name_end + 1, entry, 0, name_end + 1) == 0;
+            });
+            if (existing == into.env.end()) {
+                into.env.push_back(std::move(entry));
+            } else if (entry.compare(0, name_end, "FILEWATCH_CHANGED_KEYS") == 0) {
+                size_t start = name_end + 1;
+                while (start < entry.size()) {
+                    size_t space = entry.find(' ', start);
+                    std::string key = entry.substr(start, space == std::string::npos ? std::string::npos : space - start);
+                    std::string padded = " " + existing->substr(name_end + 1) + " ";
+                    if (padded.find(" " + key + " ") == std::string::npos) {
+                        *existing += " " + key;
+                    }
+                    if (space == std::string::npos) break;
+                    start = space + 1;
+                }
+            }
+        }
+    }
+
+    static const char* shell_path() {
+        static const char* path = access("/system/bin/sh", X_OK) == 0 ? "/system/bin/sh" : "/bin/sh";
+        return path;
+    }
+
+    void terminate(Job& job, Clock::time_point now) {
+        if (job.terminating) return;
+        kill(-job.pid, SIGTERM);
+        job.terminating = true;
+        job.deadline = now + KILL_GRACE;
+        schedule();
+    }
+
+    // 按提交顺序启动，同一监控项同一时间只运行一个
+    void dispatch() {
+        for (auto it = queue.begin(); it != queue.end() && jobs.size() < max_running;) {
+            size_t spec = it->spec;
+            if (std::any_of(jobs.begin(), jobs.end(), [spec](const Job& j) { return j.spec == spec; })) {
+                ++it;
+                continue;
+            }
+            spawn(*it);
+            it = queue.erase(it);
+        }
+        schedule();
+    }
+
+    // 通过环境变量告知动作发生了哪些变化：
+    // FILEWATCH_PATH 为最后变化的路径，FILEWATCH_PATHS 为换行分隔的全部路径，
+    // 路径过多被截断时 FILEWATCH_TRUNCATED=1
+    void spawn(const Request& request) {
+        const Action& action = request.action;
+        const Batch& batch = request.batch;
+
+        std::string joined;
+        for (const auto& path : batch.paths) {
+            if (!joined.empty()) joined += '\n';
+            joined += path;
+        }
+        std::string path_env = "FILEWATCH_PATH=" + (batch.paths.empty() ? std::string() : batch.paths.back());
+        std::string paths_env = "FILEWATCH_PATHS=" + joined;
+        std::string truncated_env = "FILEWATCH_TRUNCATED=1";
+
+        std::vector<char*> envp;
+        for (char** entry = environ; *entry; ++entry) {
+            if (strncmp(*entry, "FILEWATCH_", 10) != 0) envp.push_back(*entry);
+        }
+        envp.push_back(path_env.data());
+        envp.push_back(paths_env.data());
+        if (batch.truncated) envp.push_back(truncated_env.data());
+        for (const auto& entry : batch.env) {
+            envp.push_back(const_cast<char*>(entry.c_str()));
+        }
+        envp.push_back(nullptr);
+
+        // 子进程恢复默认信号处理，放入独立进程组
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        sigset_t empty, defaults;
+        sigemptyset(&empty);
+        sigemptyset(&defaults);
+        sigaddset(&defaults, SIGCHLD);
+        sigaddset(&defaults, SIGPIPE);
+        sigaddset(&defaults, SIGHUP);
+        posix_spawnattr_setsigmask(&attr, &empty);
+        posix_spawnattr_setsigdefault(&attr, &defaults);
+        posix_spawnattr_setpgroup(&attr, 0);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+
+        // 需要捕获输出时把标准输出/错误接到管道的写端
+        posix_spawn_file_actions_t file_actions;
+        posix_spawn_file_actions_init(&file_actions);
+        int out_pipe[2] = {-1, -1};
+        int err_pipe[2] = {-1, -1};
+        bool capture = !action.log_name.empty() && output_sink && pipe2(out_pipe, O_CLOEXEC) == 0;
+        if (capture && pipe2(err_pipe, O_CLOEXEC) != 0) {
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+            capture = false;
+        }
+        if (capture) {
+            posix_spawn_file_actions_adddup2(&file_actions, out_pipe[1], STDOUT_FILENO);
+            posix_spawn_file_actions_adddup2(&file_actions, err_pipe[1], STDERR_FILENO);
+        }
+
+        // 可执行的脚本直接 exec，省去一层 shell；否则交给 sh 解释
+        std::string command = action.command;
+        char dash_c[] = "-c";
+        char* shell = const_cast<char*>(shell_path());
+        pid_t pid = -1;
+        int err = ENOEXEC;
+        if (!action.shell && access(command.c_str(), X_OK) == 0) {
+            char* argv[] = {command.data(), nullptr};
+            err = posix_spawn(&pid, command.c_str(), &file_actions, &attr, argv, envp.data());
+        }
+        if (err == ENOEXEC || err == EACCES) {
+            char* argv[] = {shell, action.shell ? dash_c : command.data(), action.shell ? command.data() : nullptr, nullptr};
+            err = posix_spawn(&pid, shell, &file_actions, &attr, argv, envp.data());
+        }
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&file_actions);
+
+        if (capture) {
+            close(out_pipe[1]);
+            close(err_pipe[1]);
+            if (err == 0) {
+                add_pipe(out_pipe[0], STDOUT_FILENO, action.log_name);
+                add_pipe(err_pipe[0], STDERR_FILENO, action.log_name);
+            } else {
+                close(out_pipe[0]);
+                close(err_pipe[0]);
+            }
+        }
+
+        if (err != 0) {
+            watch_log(true, "cannot run " + action.command + ": " + strerror(err));
+            return;
+        }
+        histogram.record(Clock::now() - batch.first_event);
+        log_verbose("started action " + std::to_string(pid) + ": " + action.command);
+        Clock::time_point deadline = action.timeout > 0 ? Clock::now() + std::chrono::seconds(action.timeout)
+                                                        : Clock::time_point::max();
+        jobs.push_back({pid, request.spec, deadline, false});
+    }
+
+    void add_pipe(int fd, int stream, const std::string& log_name) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        struct epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(output_epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            return;
+        }
+        grow_pipe(fd);
+        pipes.push_back({fd, stream, log_name, LineReader(MAX_LINE)});
+    }
+
+    void schedule() {
+        Clock::time_point earliest = Clock::time_point::max();
+        for (const auto& job : jobs) {
+            earliest = std::min(earliest, job.deadline);
+        }
+        struct itimerspec spec {};
+        if (earliest != Clock::time_point::max()) {
+            auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(earliest.time_since_epoch()).count();
+            spec.it_value.tv_sec = since_epoch / 1000000000;
+            spec.it_value.tv_nsec = std::max<long long>(since_epoch % 1000000000, 1);
+        }
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    size_t max_running;
+    std::vector<Job> jobs;
+    std::deque<Request> queue;
+    LatencyHistogram histogram;
+    OutputSink output_sink;
+    std::vector<OutputPipe> pipes;
+    int timer_fd = -1;
+    int output_epoll = -1;
+};
+
+inline std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) return {};
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+// 去掉末尾的 '/'，保证路径拼接和前缀比较一致
+inline std::string normalize_path(std::string path) {
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    return path;
+}
+
+// 以 "-c " 开头的动作是shell命令，否则是脚本路径
+inline Action parse_action(const std::string& text) {
+    Action action;
+    if (text.compare(0, 3, "-c ") == 0) {
+        action.command = trim(text.substr(3));
+        action.shell = true;
+    } else {
+        action.command = text;
+    }
+    return action;
+}
+
+// 解析逗号分隔的监控选项: recursive, include=GLOB, exclude=GLOB, policy=queue|cancel, timeout=SECONDS, hash, keys
+inline bool parse_watch_options(const std::string& options, WatchSpec& spec) {
+    size_t start = 0;
+    while (start <= options.size()) {
+        size_t comma = options.find(',', start);
+        std::string option = trim(options.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+        if (option == "recursive") {
+            spec.recursive = true;
+        } else if (option == "hash") {
+            spec.hash = true;
+        } else if (option == "keys") {
+            spec.hash = spec.keys = true;
+        } else if (option.compare(0, 8, "include=") == 0) {
+            spec.includes.push_back(option.substr(8));
+        } else if (option.compare(0, 8, "exclude=") == 0) {
+            spec.excludes.push_back(option.substr(8));
+        } else if (option.compare(0, 7, "policy=") == 0) {
+            if (!parse_policy(option.c_str() + 7, spec.action.policy)) return false;
+        } else if (option.compare(0, 8, "timeout=") == 0) {
+            spec.action.timeout = std::max(atoi(option.c_str() + 8), 0);
+        } else if (!option.empty()) {
+            return false;
+        }
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return true;
+}
+
+// 解析监控清单中的一行: 路径|动作|选项
+inline bool parse_watch_line(const std::string& line, WatchSpec& spec) {
+    size_t first = line.find('|');
+    if (first == std::string::npos) return false;
+    size_t second = line.find('|', first + 1);
+
+    spec.path = normalize_path(trim(line.substr(0, first)));
+    spec.action = parse_action(trim(line.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1)));
+    if (spec.path.empty() || spec.action.command.empty()) return false;
+    if (second == std::string::npos) return true;
+    return parse_watch_options(line.substr(second + 1), spec);
+}
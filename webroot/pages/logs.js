@@ -16,7 +16,10 @@ const LogsPage = {
     // 自动刷新设置
     autoRefresh: false,
     refreshTimer: null,
-    refreshInterval: 5000, // 5秒刷新一次
+    refreshInterval: 5000, // 5秒刷新一次，增量读取时为最长等待时间
+
+    // 增量读取状态：已读到的字节偏移和文件 inode，由 logmonitor -c tail 返回
+    tailState: null,
     
     // 初始化
     async init() {
@@ -75,7 +78,8 @@ const LogsPage = {
             }
             
             // 获取logs目录下的所有日志文件
-            const result = await Core.execCommand(`find "${logsDir}" -type f -name "*.log" -o -name "*.log.old" 2>/dev/null | sort`);
+            // 包含轮换产生的历史代: .old / .N / .N.gz
+            const result = await Core.execCommand(`find "${logsDir}" -type f \\( -name "*.log" -o -name "*.log.*" -o -name "*.blog" -o -name "*.blog.*" \\) ! -name "*.tmp" ! -name "*.idx" 2>/dev/null | sort`);
             
             // 清空现有日志文件列表
             this.logFiles = {};
@@ -100,25 +104,107 @@ const LogsPage = {
         }
     },
     
-    // 加载日志内容
-    async loadLogContent(showToast = false) {
+    // 读取日志的命令，二进制日志和压缩的历史代由 logmonitor 渲染为文本
+    readLogCommand(logPath) {
+        if (/\.blog(\.(old|\d+))?$/.test(logPath) || /\.gz$/.test(logPath)) {
+            return `"${Core.MODULE_PATH}bin/logmonitor" -c cat -b "${logPath}"`;
+        }
+        return `cat "${logPath}"`;
+    },
+
+    // 当前文本日志可以增量读取；历史代、二进制和压缩日志仍整体读取
+    canTail(logPath) {
+        return /\.log$/.test(logPath);
+    },
+
+    // 读取上次之后新增的内容，follow 为 true 时没有新内容会等待最多 refreshInterval
+    async readLogDelta(logPath, follow = false) {
+        const fileName = logPath.split('/').pop();
+        const logDir = logPath.slice(0, logPath.length - fileName.length);
+        const state = this.tailState && this.tailState.path === logPath ? this.tailState : null;
+        let command = `"${Core.MODULE_PATH}bin/logmonitor" -c tail -d "${logDir}" -n "${fileName.replace(/\.log$/, '')}" --max-bytes 262144`;
+        if (state) {
+            command += ` --since ${state.offset} --inode ${state.inode}`;
+        }
+        if (follow) {
+            command += ` --follow --timeout ${this.refreshInterval}`;
+        }
+
+        // 首行为 "偏移 inode 是否重置"，其后是新增内容
+        const output = await Core.execCommand(command);
+        const headerEnd = output.indexOf('\n');
+        const [offset, inode, reset] = output.slice(0, headerEnd < 0 ? output.length : headerEnd).split(' ');
+        this.tailState = { path: logPath, offset, inode };
+        return { text: headerEnd < 0 ? '' : output.slice(headerEnd + 1), reset: !state || reset === '1' };
+    },
+
+    // 追加新增的日志行，只重新渲染可见区域
+    appendLogLines(text) {
+        const logsDisplay = document.getElementById('logs-display');
+        if (!this.logContent.trim()) {
+            // 之前显示的是空状态，没有可追加的行
+            this.logContent = text;
+            if (logsDisplay) {
+                logsDisplay.innerHTML = this.formatLogContent();
+                logsDisplay.scrollTop = logsDisplay.scrollHeight;
+            }
+            return;
+        }
+
+        const items = this.virtualScroll.totalItems;
+        if (items.length > 0 && items[items.length - 1].content === '') {
+            items.pop();
+        }
+        this.logContent += text;
+        text.split('\n').forEach(line => {
+            items.push({ id: items.length, content: this.formatLogLine(line) });
+        });
+
+        if (logsDisplay) {
+            const atBottom = logsDisplay.scrollTop + logsDisplay.clientHeight >= logsDisplay.scrollHeight - this.virtualScroll.itemHeight;
+            logsDisplay.innerHTML = this.renderVirtualScroll();
+            if (atBottom) {
+                logsDisplay.scrollTop = logsDisplay.scrollHeight;
+            }
+        }
+    },
+
+    // 加载日志内容，返回是否成功
+    async loadLogContent(showToast = false, follow = false) {
         try {
             if (!this.currentLogFile || !this.logFiles[this.currentLogFile]) {
                 this.logContent = I18n.translate('NO_LOG_SELECTED', '未选择日志文件');
-                return;
+                return false;
             }
             
             // 使用setTimeout让UI有机会更新
             await new Promise(resolve => setTimeout(resolve, 0));
             
             const logPath = this.logFiles[this.currentLogFile];
+
+            // 文本日志只读取新增部分，已显示的内容不再重新读取和渲染
+            if (this.canTail(logPath) && this.tailState && this.tailState.path === logPath) {
+                const delta = await this.readLogDelta(logPath, follow);
+                if (delta.reset) {
+                    this.logContent = delta.text;
+                    const logsDisplay = document.getElementById('logs-display');
+                    if (logsDisplay) {
+                        logsDisplay.innerHTML = this.formatLogContent();
+                        logsDisplay.scrollTop = logsDisplay.scrollHeight;
+                    }
+                } else if (delta.text) {
+                    this.appendLogLines(delta.text);
+                }
+                if (showToast) Core.showToast(I18n.translate('LOGS_REFRESHED', '日志已刷新'));
+                return true;
+            }
             
             // 检查文件是否存在
             const fileExistsResult = await Core.execCommand(`[ -f "${logPath}" ] && echo "true" || echo "false"`);
             if (fileExistsResult.trim() !== "true") {
                 this.logContent = I18n.translate('LOG_FILE_NOT_FOUND', '日志文件不存在');
                 if (showToast) Core.showToast(this.logContent, 'warning');
-                return;
+                return false;
             }
             
             // 显示加载指示器
@@ -130,8 +216,15 @@ const LogsPage = {
             // 使用requestIdleCallback处理大数据
             await new Promise(resolve => {
                 requestIdleCallback(async () => {
-                    const content = await Core.execCommand(`cat "${logPath}"`);
-                    this.logContent = content || I18n.translate('NO_LOGS', '没有可用的日志');
+                    if (this.canTail(logPath)) {
+                        // 首次读取文本日志的末尾，并记录之后增量读取的位置
+                        this.tailState = null;
+                        this.logContent = (await this.readLogDelta(logPath)).text;
+                    } else {
+                        const content = await Core.execCommand(this.readLogCommand(logPath));
+                        // 内存映射日志段在守护进程运行时末尾带有预分配的填充零
+                        this.logContent = (content || '').replace(/\0+$/, '') || I18n.translate('NO_LOGS', '没有可用的日志');
+                    }
                     
                     // 更新显示
                     if (logsDisplay) {
@@ -145,6 +238,7 @@ const LogsPage = {
                     resolve();
                 });
             });
+            return true;
         } catch (error) {
             console.error(I18n.translate('LOGS_LOAD_ERROR', '加载日志内容失败:'), error);
             this.logContent = I18n.translate('LOGS_LOAD_ERROR', '加载失败');
@@ -155,6 +249,7 @@ const LogsPage = {
             }
             
             if (showToast) Core.showToast(this.logContent, 'error');
+            return false;
         }
     },
     
@@ -259,19 +354,33 @@ const LogsPage = {
     },
     
     // 启动/停止自动刷新
+    // 文本日志由 logmonitor -c tail --follow 阻塞等待新内容，其余日志按间隔整体重新读取
     toggleAutoRefresh(enable) {
         if (enable) {
+            this.autoRefresh = true;
             if (this.refreshTimer) {
-                clearInterval(this.refreshTimer);
+                return;
             }
-            this.autoRefresh = true;
-            this.refreshTimer = setInterval(() => this.loadLogContent(), this.refreshInterval);
+            const token = this.refreshTimer = {};
+            const sleep = () => new Promise(resolve => setTimeout(resolve, this.refreshInterval));
+            (async () => {
+                while (this.autoRefresh && this.refreshTimer === token) {
+                    const logPath = this.logFiles[this.currentLogFile];
+                    if (logPath && this.canTail(logPath)) {
+                        if (!await this.loadLogContent(false, true)) {
+                            await sleep();
+                        }
+                    } else {
+                        await sleep();
+                        if (this.autoRefresh && this.refreshTimer === token) {
+                            await this.loadLogContent();
+                        }
+                    }
+                }
+            })();
             console.log(I18n.translate('AUTO_REFRESH_STARTED', '自动刷新已启动'));
         } else {
-            if (this.refreshTimer) {
-                clearInterval(this.refreshTimer);
-                this.refreshTimer = null;
-            }
+            this.refreshTimer = null;
             this.autoRefresh = false;
             console.log(I18n.translate('AUTO_REFRESH_STOPPED', '自动刷新已停止'));
         }